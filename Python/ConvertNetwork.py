@@ -0,0 +1,96 @@
+import argparse
+import numpy as np
+
+# Converts a raw network exported by the trainer into Renegade's headered network format
+# Example: python ConvertNetwork.py renegade-net-36.bin renegade-net-36-int8.bin --int8
+#          python ConvertNetwork.py small-net.bin small-net-converted.bin --arch small
+
+# These must match Architecture.h
+# (hidden size, input buckets, output buckets) of each supported architecture
+ARCHITECTURES = {
+    "large": (1600, 14, 8),
+    "small": (512, 1, 8),
+}
+FEATURE_SIZE = 768
+QA = 255
+QB = 64
+SCALE = 400
+INT8_SHIFT = 2
+
+MAGIC = b"RENEGADE"
+FORMAT_VERSION = 1
+
+"""
+ Network layout (each part aligned to 64 bytes, same as NetworkRepresentation):
+  - feature weights: InputBucketCount * FeatureSize * HiddenSize (int16 or int8)
+  - feature bias: HiddenSize (int16)
+  - output weights: OutputBucketCount * (HiddenSize * 2) (int16)
+  - output bias: OutputBucketCount (int16)
+"""
+
+
+def pad_to_64(data):
+    return data + bytes((-len(data)) % 64)
+
+
+def checksum(payload):
+    # Same as NetworkChecksum() in Neural.cpp: sum of 64-bit words times distinct odd numbers
+    words = np.frombuffer(payload, dtype=np.uint64)
+    multipliers = np.arange(len(words), dtype=np.uint64) * np.uint64(2) + np.uint64(1)
+    with np.errstate(over="ignore"):
+        return int(np.sum(words * multipliers, dtype=np.uint64))
+
+
+def load_raw_network(path, hidden_size, input_buckets, output_buckets):
+    data = np.fromfile(path, dtype=np.int16)
+    feature_weights_end = input_buckets * FEATURE_SIZE * hidden_size
+    feature_bias_end = feature_weights_end + hidden_size
+    output_weights_end = feature_bias_end + output_buckets * hidden_size * 2
+    output_bias_end = output_weights_end + output_buckets
+    if len(data) < output_bias_end:
+        raise ValueError("file is too small for the architecture")
+    return (data[0:feature_weights_end], data[feature_weights_end:feature_bias_end],
+            data[feature_bias_end:output_weights_end], data[output_weights_end:output_bias_end])
+
+
+def quantize_int8(feature_weights):
+    # Round to the nearest multiple of 2^shift, and report how much is lost
+    scaled = np.round(feature_weights.astype(np.float64) / (1 << INT8_SHIFT))
+    clipped = np.count_nonzero((scaled < -128) | (scaled > 127))
+    quantized = np.clip(scaled, -128, 127).astype(np.int8)
+    error = np.abs(quantized.astype(np.int32) * (1 << INT8_SHIFT) - feature_weights.astype(np.int32))
+    print("Feature weight range:  ", feature_weights.min(), "...", feature_weights.max())
+    print("Clipped weights:       ", clipped, "/", len(feature_weights))
+    print("Mean / max abs. error: ", round(float(error.mean()), 4), "/", int(error.max()))
+    return quantized
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a raw trainer network into Renegade's network format")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    parser.add_argument("--int8", action="store_true", help="store the feature weights as int8")
+    parser.add_argument("--arch", choices=ARCHITECTURES.keys(), default="large", help="architecture of the network")
+    args = parser.parse_args()
+
+    hidden_size, input_buckets, output_buckets = ARCHITECTURES[args.arch]
+    feature_weights, feature_bias, output_weights, output_bias = load_raw_network(args.input, hidden_size, input_buckets, output_buckets)
+    if args.int8:
+        feature_weights = quantize_int8(feature_weights)
+
+    payload = pad_to_64(feature_weights.tobytes()) + pad_to_64(feature_bias.tobytes()) \
+        + pad_to_64(output_weights.tobytes()) + pad_to_64(output_bias.tobytes())
+
+    header = MAGIC + np.array([
+        FORMAT_VERSION, 8 if args.int8 else 16, INT8_SHIFT if args.int8 else 0,
+        FEATURE_SIZE, hidden_size, input_buckets, output_buckets, QA, QB, SCALE
+    ], dtype=np.uint32).tobytes() + np.array([len(payload), checksum(payload)], dtype=np.uint64).tobytes()
+    assert len(header) == 64
+
+    with open(args.output, "wb") as file:
+        file.write(header + payload)
+    print("Written", args.output, "(", len(header) + len(payload), "bytes )")
+
+
+if __name__ == "__main__":
+    main()
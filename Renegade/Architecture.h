@@ -0,0 +1,90 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Shapes of the neural networks
+// This is kept separate from Neural.h, as the SIMD kernels are compiled on their own for each
+// instruction set, and they must not pull in the rest of the engine
+
+// Each supported shape is described by a NetworkArchitecture type, and everything depending on the
+// shape (the network layout and the kernels) is instantiated for all of them at compile time
+// The network file's header decides which one is used at runtime, so for example a smaller network
+// can be loaded for faster games without rebuilding the engine
+
+constexpr int FeatureSize = 768;  // same for every architecture: 2 colors * 6 piece types * 64 squares
+
+template <std::string_view const& name, int hiddenSize, int inputBucketCount, std::array<int, 32> inputBucketMap,
+	int outputBucketCount, int qa = 255, int qb = 64, int scale = 400>
+struct NetworkArchitecture {
+	static constexpr std::string_view Name = name;
+	static constexpr int HiddenSize = hiddenSize;
+	static constexpr int InputBucketCount = inputBucketCount;
+	static constexpr std::array<int, 32> InputBucketMap = inputBucketMap;
+	static constexpr int OutputBucketCount = outputBucketCount;
+	static constexpr int QA = qa;
+	static constexpr int QB = qb;
+	static constexpr int Scale = scale;
+
+	static_assert(HiddenSize % 32 == 0, "the hidden layer must fill whole vectors of every instruction set");
+	static_assert(*std::max_element(InputBucketMap.begin(), InputBucketMap.end()) == InputBucketCount - 1);
+};
+
+// The input bucket map is indexed by the king's square (horizontally mirrored, so 4 files per rank)
+namespace Internal {
+	inline constexpr std::string_view LargeName = "large";
+	inline constexpr std::string_view SmallName = "small";
+
+	constexpr std::array<int, 32> LargeInputBucketMap = {
+		 0,  1,  2,  3,
+		 4,  5,  6,  7,
+		 8,  8,  9,  9,
+		10, 10, 11, 11,
+		10, 10, 11, 11,
+		12, 12, 13, 13,
+		12, 12, 13, 13,
+		12, 12, 13, 13,
+	};
+	constexpr std::array<int, 32> SingleInputBucketMap = {};
+}
+
+// (768x14hm -> 1600)x2 -> 1x8, the main network embedded into the engine
+using LargeArchitecture = NetworkArchitecture<Internal::LargeName, 1600, 14, Internal::LargeInputBucketMap, 8>;
+// (768hm -> 512)x2 -> 1x8, cheaper to update and evaluate
+using SmallArchitecture = NetworkArchitecture<Internal::SmallName, 512, 1, Internal::SingleInputBucketMap, 8>;
+
+using DefaultArchitecture = LargeArchitecture;
+
+// All architectures compiled into the engine, the index in this list identifies them at runtime
+// (architectures must differ in their shape, as that's what the network header is matched against)
+template <typename... Architectures>
+struct ArchitectureList {
+	static constexpr std::size_t Count = sizeof...(Architectures);
+	static constexpr int MaxHiddenSize = std::max({ Architectures::HiddenSize... });
+	static constexpr int MaxInputBucketCount = std::max({ Architectures::InputBucketCount... });
+
+	// Calls f.template operator()<Architecture>(index) for each architecture
+	template <typename F>
+	static void ForEach(F&& f) {
+		std::size_t index = 0;
+		(f.template operator()<Architectures>(index++), ...);
+	}
+};
+
+using SupportedArchitectures = ArchitectureList<LargeArchitecture, SmallArchitecture>;
+constexpr std::size_t DefaultArchitectureIndex = 0;
+constexpr int MaxHiddenSize = SupportedArchitectures::MaxHiddenSize;
+constexpr int MaxInputBucketCount = SupportedArchitectures::MaxInputBucketCount;
+
+// Feature weights can be stored as int8 to halve their memory footprint and bandwidth (make quant=int8)
+// These are widened to int16 on the fly and shifted back to the scale of the accumulator, the shift is
+// fixed for the build, and it's also stored in the network file's header
+#if defined(RENEGADE_INT8_WEIGHTS)
+using FeatureWeight = int8_t;
+constexpr int FeatureWeightShift = 2;
+#else
+using FeatureWeight = int16_t;
+constexpr int FeatureWeightShift = 0;
+#endif
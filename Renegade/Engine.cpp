@@ -1,4 +1,5 @@
 #include "Engine.h"
+#include "Magics.h"
 
 Engine::Engine(int argc, char* argv[]) {
 	Settings::UseUCI = !PrettySupport;
@@ -90,6 +91,15 @@ void Engine::Start() {
 			cout << "option name Threads type spin default " << ThreadsDefault << " min " << ThreadsMin << " max " << ThreadsMax << '\n';
 			cout << "option name UCI_ShowWDL type check default " << (ShowWDLDefault ? "true" : "false") << '\n';
 			cout << "option name UCI_Chess960 type check default " << (Chess960Default ? "true" : "false") << '\n';
+			cout << "option name EvalFile type string default " << EvalFileDefault << '\n';
+			cout << "option name NetworkHugePages type check default " << (NetworkHugePagesDefault ? "true" : "false") << '\n';
+			cout << "option name NetworkLockMemory type check default " << (NetworkLockMemoryDefault ? "true" : "false") << '\n';
+			cout << "option name HybridEvalThreshold type spin default " << HybridEvalThresholdDefault << " min " << HybridEvalThresholdMin << " max " << HybridEvalThresholdMax << '\n';
+			cout << "option name MultiPV type spin default " << MultiPVDefault << " min " << MultiPVMin << " max " << MultiPVMax << '\n';
+			cout << "option name Ponder type check default " << (PonderDefault ? "true" : "false") << '\n';
+			cout << "option name Move Overhead type spin default " << MoveOverheadDefault << " min " << MoveOverheadMin << " max " << MoveOverheadMax << '\n';
+			cout << "option name nodestime type spin default " << NodesTimeDefault << " min " << NodesTimeMin << " max " << NodesTimeMax << '\n';
+			cout << "option name NumaPolicy type combo default none var none var bind var replicate" << '\n';
 			if (IsTuningActive()) PrintTunableParameters();
 			cout << "uciok" << endl;
 			Settings::UseUCI = true;
@@ -97,6 +107,7 @@ void Engine::Start() {
 		else if (command == "ucinewgame") {
 			searchThreads.WaitUntilReady();
 			searchThreads.ResetState(true);
+			searchThreads.ResetNodesTime();
 		}
 		else if (command == "isready") {
 			cout << "readyok" << endl;
@@ -104,8 +115,11 @@ void Engine::Start() {
 		else if (command == "stop" || command == "s") {
 			searchThreads.StopSearch();
 		}
+		else if (command == "ponderhit") {
+			searchThreads.PonderHit();
+		}
 		else if (command == "setoption") {
-			HandleSetOption(parts);
+			HandleSetOption(parts, originalInput);
 		}
 		else if (command == "position") {
 			HandlePosition(originalInput);
@@ -119,6 +133,22 @@ void Engine::Start() {
 		else if (command == "bench" || command == "b") {
 			HandleBench();
 		}
+		else if (command == "poollatency") {
+			searchThreads.WaitUntilReady();
+			HandlePoolLatency();
+		}
+		else if (command == "rootmoves") {
+			searchThreads.WaitUntilReady();
+			searchThreads.PrintRootMoves();
+		}
+		else if (command == "benchsmp") {
+			searchThreads.WaitUntilReady();
+			HandleBenchSMP(parts);
+		}
+		else if (command == "benchprefetch") {
+			searchThreads.WaitUntilReady();
+			HandleBenchPrefetch();
+		}
 		else if (command == "draw" || command == "d") {
 			HandleDraw(position);
 		}
@@ -129,8 +159,13 @@ void Engine::Start() {
 			HandleCompiler();
 		}
 		else if (command == "nnue") {
+			searchThreads.WaitUntilReady();  // the counters are written by the search threads
 			HandleNNUE();
 		}
+		else if (command == "evalbatch") {
+			searchThreads.WaitUntilReady();
+			HandleEvalBatch(originalInput);
+		}
 		else if (command == "help") {
 			HandleHelp();
 		}
@@ -217,7 +252,7 @@ void Engine::Start() {
 	searchThreads.StopThreads();
 }
 
-void Engine::HandleSetOption(const std::vector<std::string>& parts) {
+void Engine::HandleSetOption(const std::vector<std::string>& parts, const std::string& originalInput) {
 	if (parts.size() == 1) {
 		cout << "Error: Missing parameters" << endl;
 		return;
@@ -264,6 +299,59 @@ void Engine::HandleSetOption(const std::vector<std::string>& parts) {
 		const std::optional<bool> value = ParseUCIBoolean(optionValue);
 		if (value.has_value()) Settings::ShowWDL = value.value();
 	}
+	else if (optionName == "evalfile") {
+		// File paths are case sensitive, so the value is taken from the original input
+		const std::vector<std::string> originalParts = Split(originalInput);
+		std::string path = "";
+		for (std::size_t i = valuePos + 1; i < originalParts.size(); i++) path += originalParts[i] + " ";
+		path = Trim(path);
+
+		// The network is only switched between searches
+		searchThreads.WaitUntilReady();
+		const bool useDefault = path.empty() || path == EvalFileDefault;
+		if (useDefault) RestoreDefaultNetwork();
+		else if (!LoadNetworkFromFile(path)) return;
+
+		Settings::EvalFile = useDefault ? std::string(EvalFileDefault) : path;
+		searchThreads.ResetEvaluationState();
+	}
+	else if (optionName == "networkhugepages" || optionName == "networklockmemory") {
+		const std::optional<bool> value = ParseUCIBoolean(optionValue);
+		if (!value.has_value()) return;
+		if (optionName == "networkhugepages") Settings::NetworkHugePages = value.value();
+		else Settings::NetworkLockMemory = value.value();
+
+		// The weights stay the same, only their location changes, so no state needs to be reset
+		searchThreads.WaitUntilReady();
+		SetNetworkMemoryOptions(Settings::NetworkHugePages, Settings::NetworkLockMemory);
+	}
+	else if (optionName == "hybridevalthreshold") {
+		Settings::HybridEvalThreshold = std::clamp(std::stoi(optionValue), HybridEvalThresholdMin, HybridEvalThresholdMax);
+	}
+	else if (optionName == "multipv") {
+		Settings::MultiPV = std::clamp(std::stoi(optionValue), MultiPVMin, MultiPVMax);
+	}
+	else if (optionName == "move overhead") {
+		Settings::MoveOverhead = std::clamp(std::stoi(optionValue), MoveOverheadMin, MoveOverheadMax);
+	}
+	else if (optionName == "nodestime") {
+		Settings::NodesTime = std::clamp(std::stoi(optionValue), NodesTimeMin, NodesTimeMax);
+	}
+	else if (optionName == "numapolicy") {
+		if (optionValue == "none") Settings::NumaPlacement = NumaPolicy::None;
+		else if (optionValue == "bind") Settings::NumaPlacement = NumaPolicy::Bind;
+		else if (optionValue == "replicate") Settings::NumaPlacement = NumaPolicy::Replicate;
+		else {
+			cout << "Error: unknown NUMA policy '" << optionValue << "'" << endl;
+			return;
+		}
+		searchThreads.ApplyNumaPolicy();
+		if (Settings::NumaPlacement != NumaPolicy::None) cout << "info string NUMA: " << Numa::DescribeTopology() << endl;
+	}
+	else if (optionName == "ponder") {
+		const std::optional<bool> value = ParseUCIBoolean(optionValue);
+		if (value.has_value()) Settings::Ponder = value.value();
+	}
 	else if (IsTuningActive() && HasTunableParameter(parts[2])) {
 		SetTunableParameter(optionName, std::stoi(optionValue));
 	}
@@ -353,6 +441,7 @@ void Engine::HandleGo(const std::vector<std::string>& parts) {
 	for (size_t i = 1; i < parts.size(); i++) {
 
 		if (parts[i] == "infinite") continue;  // default is to assume an unbounded search
+		else if (parts[i] == "ponder") params.ponder = true;
 
 		else if (parts[i] == "wtime") params.wtime = std::max(std::stoi(parts[++i]), 1);
 		else if (parts[i] == "btime") params.btime = std::max(std::stoi(parts[++i]), 1);
@@ -369,7 +458,11 @@ void Engine::HandleGo(const std::vector<std::string>& parts) {
 			cout << "info string Warning: mate parameter is not yet implemented" << endl;
 		}
 		else if (parts[i] == "searchmoves") {
-			cout << "info string Warning: searchmoves parameter is not yet implemented" << endl;
+			// The moves follow until the next parameter
+			while (i + 1 < parts.size() && parts[i + 1].size() >= 4 && parts[i + 1].size() <= 5
+				&& parts[i + 1][0] >= 'a' && parts[i + 1][0] <= 'h' && parts[i + 1][1] >= '1' && parts[i + 1][1] <= '8') {
+				params.searchmoves.push_back(parts[++i]);
+			}
 		}
 	}
 
@@ -415,6 +508,111 @@ void Engine::HandleBench() {
 	Settings::Chess960 = oldChess960Setting;
 }
 
+// Measures how much the extra threads help: the bench positions are searched to the same depth with a single
+// thread and with multiple threads, with the TT cleared before each, and the time to depth is compared
+void Engine::HandleBenchSMP(const std::vector<std::string>& parts) {
+	const int threadCount = (parts.size() > 1) ? std::clamp(std::stoi(parts[1]), 2, ThreadsMax)
+		: std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 2, ThreadsMax);
+	SearchParams params{};
+	params.depth = (parts.size() > 2) ? std::stoi(parts[2]) : 10;
+
+	const int oldThreadCount = Settings::Threads;
+	const bool oldChess960Setting = Settings::Chess960;
+	searchThreads.Silent = true;
+	std::array<double, 2> totalSeconds{};
+
+	for (int config = 0; config < 2; config++) {
+		Settings::Threads = (config == 0) ? 1 : threadCount;
+		searchThreads.SetThreadCount(Settings::Threads);
+		uint64_t nodes = 0;
+		int depthSum = 0;
+
+		for (std::string fen : BenchmarkFENs) {
+			Settings::Chess960 = false;
+			if (fen.starts_with("[frc]")) {
+				Settings::Chess960 = true;
+				fen = fen.substr(6, fen.length() - 6);
+			}
+			searchThreads.ResetState(true);
+			Position pos = Position(fen);
+			const auto startTime = Clock::now();
+			searchThreads.StartSearch(pos, params);
+			searchThreads.WaitUntilReady();
+			totalSeconds[config] += (Clock::now() - startTime).count() / 1e9;
+			const Results r = searchThreads.GetSearchResults();
+			nodes += r.nodes;
+			depthSum += r.depth;
+		}
+
+		cout << "-> " << std::setw(3) << Settings::Threads << " thread(s): " << std::fixed << std::setprecision(2) << totalSeconds[config] << " s, "
+			<< Console::FormatInteger(nodes) << " nodes, " << Console::FormatInteger(static_cast<uint64_t>(nodes / totalSeconds[config])) << " nps, "
+			<< "avg depth " << static_cast<double>(depthSum) / BenchmarkFENs.size() << endl;
+	}
+	cout << "-> Time to depth " << params.depth << " speedup: " << std::fixed << std::setprecision(2) << totalSeconds[0] / totalSeconds[1] << "x" << endl;
+	cout << std::defaultfloat << std::setprecision(6);
+
+	searchThreads.Silent = false;
+	Settings::Chess960 = oldChess960Setting;
+	Settings::Threads = oldThreadCount;
+	searchThreads.SetThreadCount(oldThreadCount);
+	searchThreads.ResetState(true);
+}
+
+// Runs the bench without and with software prefetching, to see whether it still pays off on the machine
+// Prefetching doesn't affect the search, so the node counts must match
+void Engine::HandleBenchPrefetch() {
+	for (const bool prefetch : { false, true }) {
+		Settings::SoftwarePrefetch = prefetch;
+		for (ThreadData& t : searchThreads.Threads) t.Prefetches = PrefetchCounters();
+		cout << "-> Prefetching " << (prefetch ? "enabled:  " : "disabled: ") << std::flush;
+		HandleBench();
+	}
+
+	PrefetchCounters counters{};
+	for (const ThreadData& t : searchThreads.Threads) counters += t.Prefetches;
+	cout << "-> Prefetched weight rows:      " << Console::FormatInteger(counters.WeightRows) << endl;
+	cout << "-> Prefetched correction slots: " << Console::FormatInteger(counters.HistorySlots) << endl;
+	Settings::SoftwarePrefetch = true;
+}
+
+// Measures the latencies of the thread pool with the current thread count, using short infinite searches
+// Start: from the go command until the last thread woke up, stop: from the stop command until all threads are idle
+void Engine::HandlePoolLatency() {
+	constexpr int rounds = 20;
+	const auto micros = [](const auto duration) { return std::chrono::duration_cast<std::chrono::microseconds>(duration).count(); };
+	int64_t startSum = 0, startMax = 0, stopSum = 0, stopMax = 0;
+
+	searchThreads.Silent = true;
+	for (int i = 0; i < rounds; i++) {
+		const auto startTime = Clock::now();
+		searchThreads.StartSearch(position, SearchParams());
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		const auto stopTime = Clock::now();
+		searchThreads.StopSearch();
+		const auto idleTime = Clock::now();
+
+		int64_t startLatency = 0;
+		for (const ThreadData& t : searchThreads.Threads) startLatency = std::max(startLatency, micros(t.WokenAt - startTime));
+		const int64_t stopLatency = micros(idleTime - stopTime);
+		startSum += startLatency;
+		stopSum += stopLatency;
+		startMax = std::max(startMax, startLatency);
+		stopMax = std::max(stopMax, stopLatency);
+	}
+	searchThreads.Silent = false;
+
+	const auto resizeStart = Clock::now();
+	searchThreads.SetThreadCount(Settings::Threads + 1);
+	const auto resizeMiddle = Clock::now();
+	searchThreads.SetThreadCount(Settings::Threads);
+	const auto resizeEnd = Clock::now();
+
+	cout << "-> Thread pool latencies with " << Settings::Threads << " thread(s), over " << rounds << " searches:" << endl;
+	cout << "   go -> all threads searching: avg " << startSum / rounds << " us, max " << startMax << " us" << endl;
+	cout << "   stop -> all threads idle:    avg " << stopSum / rounds << " us, max " << stopMax << " us" << endl;
+	cout << "   adding a thread: " << micros(resizeMiddle - resizeStart) << " us, removing it: " << micros(resizeEnd - resizeMiddle) << " us" << endl;
+}
+
 void Engine::HandleDraw(const Position& pos, const uint64_t highlight) const {
 
 	constexpr std::string_view whiteOnLightSquare = "\033[31;47m";
@@ -525,11 +723,193 @@ void Engine::HandleDraw(const Position& pos, const uint64_t highlight) const {
 	cout << endl;
 }
 
+// Evaluates every position of a FEN or EPD file with the network, and writes a 'fen | eval' line for each
+// The file is processed in chunks, so results are streamed out even for very large files
+// Anything after the FEN on a line (EPD opcodes, or '|' separated annotations) is ignored
+// Checks the fields of a FEN (without the clocks) closely enough for the position to be set up safely:
+// 8 ranks of 8 squares with one king per side and no pawns on the back ranks, and valid side to move,
+// castling (standard or Shredder-FEN) and en passant fields
+static bool IsWellFormedFEN(const std::vector<std::string>& fields) {
+	const std::vector<std::string> ranks = [&] {
+		std::vector<std::string> result(1);
+		for (const char c : fields[0]) {
+			if (c == '/') result.emplace_back();
+			else result.back() += c;
+		}
+		return result;
+	}();
+	if (ranks.size() != 8) return false;
+	for (std::size_t r = 0; r < 8; r++) {
+		int files = 0;
+		for (const char c : ranks[r]) {
+			if (c >= '1' && c <= '8') files += c - '0';
+			else if (std::string_view("PNBRQKpnbrqk").find(c) != std::string_view::npos) files += 1;
+			else return false;
+			if ((c == 'P' || c == 'p') && (r == 0 || r == 7)) return false;
+		}
+		if (files != 8) return false;
+	}
+	if (std::ranges::count(fields[0], 'K') != 1 || std::ranges::count(fields[0], 'k') != 1) return false;
+
+	if (fields[1] != "w" && fields[1] != "b") return false;
+
+	if (fields[2] != "-") {
+		if (fields[2].size() > 4) return false;
+		for (std::size_t i = 0; i < fields[2].size(); i++) {
+			if (std::string_view("KQkqABCDEFGHabcdefgh").find(fields[2][i]) == std::string_view::npos) return false;
+			if (fields[2].find(fields[2][i], i + 1) != std::string::npos) return false;
+		}
+	}
+
+	if (fields[3] != "-") {
+		const char expectedRank = (fields[1] == "w") ? '6' : '3';
+		if (fields[3].size() != 2 || fields[3][0] < 'a' || fields[3][0] > 'h' || fields[3][1] != expectedRank) return false;
+	}
+	return true;
+}
+
+// Splits the arguments at spaces, except within double quotes, so that paths with spaces can be given
+static std::vector<std::string> SplitQuotedArguments(const std::string& input) {
+	std::vector<std::string> arguments;
+	std::string current;
+	bool quoted = false, started = false;
+	for (const char c : input) {
+		if (c == '"') {
+			quoted = !quoted;
+			started = true;
+		}
+		else if (c == ' ' && !quoted) {
+			if (started) arguments.push_back(current);
+			current.clear();
+			started = false;
+		}
+		else {
+			current += c;
+			started = true;
+		}
+	}
+	if (started) arguments.push_back(current);
+	return arguments;
+}
+
+void Engine::HandleEvalBatch(const std::string& originalInput) {
+	const std::vector<std::string> parts = SplitQuotedArguments(Trim(originalInput));
+	if (parts.size() < 2) {
+		cout << "Usage: evalbatch [file] [output file] (paths containing spaces need to be quoted)" << endl;
+		return;
+	}
+
+	std::ifstream input(parts[1]);
+	if (!input) {
+		cout << "Error: could not open '" << parts[1] << "'" << endl;
+		return;
+	}
+	std::ofstream outputFile;
+	if (parts.size() >= 3) {
+		outputFile.open(parts[2]);
+		if (!outputFile) {
+			cout << "Error: could not open '" << parts[2] << "' for writing" << endl;
+			return;
+		}
+	}
+	std::ostream& output = outputFile.is_open() ? static_cast<std::ostream&>(outputFile) : static_cast<std::ostream&>(cout);
+
+	// Returns the FEN part of a line, with the clocks added for EPD positions
+	const auto extractFEN = [](const std::string& line) -> std::optional<std::string> {
+		const std::vector<std::string> tokens = Split(line.substr(0, line.find_first_of("|;")));
+		if (tokens.size() < 4 || !IsWellFormedFEN(tokens)) return std::nullopt;
+
+		const auto isNumber = [](const std::string& str) { return str.find_first_not_of("0123456789") == std::string::npos; };
+		std::string fen = tokens[0] + " " + tokens[1] + " " + tokens[2] + " " + tokens[3];
+		if (tokens.size() >= 6 && isNumber(tokens[4]) && isNumber(tokens[5])) fen += " " + tokens[4] + " " + tokens[5];
+		else fen += " 0 1";
+		return fen;
+	};
+
+	constexpr std::size_t chunkSize = 65536;
+	BatchEvaluator evaluator(Settings::Threads);
+	const auto startTime = Clock::now();
+	uint64_t evaluated = 0, skipped = 0;
+	std::vector<std::string> fens;
+	std::string line;
+	bool reachedEnd = false;
+
+	while (!reachedEnd) {
+		fens.clear();
+		while (fens.size() < chunkSize) {
+			if (!std::getline(input, line)) {
+				reachedEnd = true;
+				break;
+			}
+			line = Trim(line);
+			if (line.empty() || line[0] == '#') continue;
+			const std::optional<std::string> fen = extractFEN(line);
+			if (fen.has_value()) fens.push_back(fen.value());
+			else skipped += 1;
+		}
+
+		const std::vector<int16_t> scores = evaluator.Evaluate(fens);
+		for (std::size_t i = 0; i < fens.size(); i++) output << fens[i] << " | " << scores[i] << '\n';
+		output.flush();
+		evaluated += fens.size();
+	}
+
+	const float seconds = static_cast<float>((Clock::now() - startTime).count() / 1e9);
+	cout << "-> Evaluated " << Console::FormatInteger(evaluated) << " positions in " << std::setprecision(2) << std::fixed << seconds
+		<< " s (" << Console::FormatInteger(static_cast<uint64_t>(evaluated / std::max(seconds, 0.001f))) << " pos/s)";
+	if (skipped != 0) cout << ", skipped " << Console::FormatInteger(skipped) << " invalid lines";
+	cout << endl;
+}
+
 void Engine::HandleNNUE() const {
-	cout << "-> Arch: (" << FeatureSize << "x" << InputBucketCount << "hm -> " << HiddenSize << ")x2" << " -> 1x" << OutputBucketCount
-		<< "  [SCReLU, QA=" << QA << ", QB=" << QB << "]" << endl;
-	cout << "-> Net name: " << NETWORK_NAME << endl;
-	cout << "-> Net size: " << Console::FormatInteger(sizeof(NetworkRepresentation)) << endl;
+	cout << "-> Arch: (" << FeatureSize << "x" << Network.InputBucketCount << "hm -> " << Network.HiddenSize << ")x2" << " -> 1x" << Network.OutputBucketCount
+		<< "  [SCReLU, QA=" << Network.QA << ", QB=" << Network.QB << "] (" << Network.ArchitectureName << ")" << endl;
+	cout << "-> Supported archs:";
+	SupportedArchitectures::ForEach([&]<typename Architecture>(const std::size_t index) {
+		cout << (index != 0 ? ", " : " ") << Architecture::Name << " (" << FeatureSize << "x" << Architecture::InputBucketCount << "hm -> "
+			<< Architecture::HiddenSize << ")x2 -> 1x" << Architecture::OutputBucketCount;
+	});
+	cout << endl;
+	cout << "-> Net name: " << (Settings::EvalFile == EvalFileDefault ? std::string(NETWORK_NAME) : Settings::EvalFile) << endl;
+	cout << "-> Net size: " << Console::FormatInteger(Network.Size) << endl;
+	cout << "-> Net memory: " << DescribeNetworkMemory() << endl;
+	cout << "-> Feature weights: int" << sizeof(FeatureWeight) * 8;
+	if (FeatureWeightShift != 0) cout << " (shifted left by " << FeatureWeightShift << ")";
+	cout << endl;
+
+	// Accumulator update statistics summed over the search threads
+	AccumulatorUpdateCounters counters{};
+	for (const ThreadData& t : searchThreads.Threads) counters += t.EvalState.UpdateCounters;
+	const uint64_t total = counters.Incremental + counters.CatchUp + counters.BucketCache + counters.FullRefresh;
+	const auto print = [&](const std::string_view name, const uint64_t count) {
+		const double percentage = (total != 0) ? (100.0 * count / total) : 0.0;
+		cout << "   " << name << Console::FormatInteger(count) << " (" << std::fixed << std::setprecision(1) << percentage << "%)" << endl;
+	};
+	cout << "-> Accumulator updates: " << Console::FormatInteger(total) << endl;
+	print("incremental:  ", counters.Incremental);
+	print("catch-up:     ", counters.CatchUp);
+	print("bucket cache: ", counters.BucketCache);
+	print("full refresh: ", counters.FullRefresh);
+
+	// Evaluation cache statistics, a low hit rate with many lookups may call for a bigger cache
+	uint64_t hits = 0, misses = 0;
+	for (const ThreadData& t : searchThreads.Threads) {
+		hits += t.EvalState.OutputCache.Hits;
+		misses += t.EvalState.OutputCache.Misses;
+	}
+	const double hitRate = (hits + misses != 0) ? (100.0 * hits / (hits + misses)) : 0.0;
+	cout << "-> Eval cache: " << Console::FormatInteger(EvalCache::Size) << " entries per thread ("
+		<< Console::FormatInteger(sizeof(EvalCache::Entries)) << " bytes)" << endl;
+	cout << "   hits:   " << Console::FormatInteger(hits) << " (" << std::fixed << std::setprecision(1) << hitRate << "%)" << endl;
+	cout << "   misses: " << Console::FormatInteger(misses) << endl;
+
+	// Share of evaluations handled by the classical evaluation (only used with a non-zero HybridEvalThreshold)
+	HybridEvalCounters hybrid{};
+	for (const ThreadData& t : searchThreads.Threads) hybrid += t.HybridCounters;
+	const double classicalRate = (hybrid.Classical + hybrid.Network != 0) ? (100.0 * hybrid.Classical / (hybrid.Classical + hybrid.Network)) : 0.0;
+	cout << "-> Hybrid evaluation: threshold " << Settings::HybridEvalThreshold << (Settings::HybridEvalThreshold == 0 ? " (disabled)" : "") << endl;
+	cout << "   classical: " << Console::FormatInteger(hybrid.Classical) << " (" << std::fixed << std::setprecision(1) << classicalRate << "%)" << endl;
+	cout << "   network:   " << Console::FormatInteger(hybrid.Network) << endl;
 }
 
 void Engine::HandleCompiler() const {
@@ -545,6 +925,25 @@ void Engine::HandleCompiler() const {
 #else
 	cout << "-> Unknown - Interesting compiler you've got there!" << endl;
 #endif
+
+#if defined(RENEGADE_DISPATCH)
+	cout << "-> Build: universal (kernels selected at runtime)" << endl;
+#else
+	cout << "-> Build: fixed (kernels selected at compile time)" << endl;
+#endif
+	cout << "-> NNUE kernels: " << Kernels.Name << endl;
+	cout << "-> Slider lookups: " << GetSliderLookupMethod() << endl;
+
+	const CpuFeatures& cpu = GetCpuFeatures();
+	cout << "-> CPU features:";
+	if (cpu.SSE2) cout << " sse2";
+	if (cpu.POPCNT) cout << " popcnt";
+	if (cpu.AVX2) cout << " avx2";
+	if (cpu.BMI2) cout << " bmi2" << (cpu.FastPext ? "" : " (slow pext)");
+	if (cpu.AVX512F) cout << " avx512f";
+	if (cpu.AVX512BW) cout << " avx512bw";
+	if (cpu.AVX512VNNI) cout << " avx512vnni";
+	cout << endl;
 }
 
 void Engine::HandleHelp() const {
@@ -553,10 +952,15 @@ void Engine::HandleHelp() const {
 		<< "sets up the board and 'go depth 5' initiates a 5 ply deep search.\n" 
 		<< "Read up on the UCI protocol for more information." << endl;
 	cout << "There are some additional commands supported as well, including: "
+		<< "\n- benchprefetch: runs the bench with and without software prefetching"
+		<< "\n- benchsmp [threads] [depth]: compares the time to reach a depth with one and with multiple threads"
 		<< "\n- draw: draws the current board"
 		<< "\n- eval: prints the static evaluation of the position"
+		<< "\n- evalbatch [file] [output]: evaluates each FEN/EPD line of a file, writing 'fen | eval' lines"
 		<< "\n- fen: displays the current position's FEN string"
-		<< "\n- go perft [n] & go perftdiv [n]: returns the number of possible positions after n plies (incl. duplicates)\n" << endl;
+		<< "\n- go perft [n] & go perftdiv [n]: returns the number of possible positions after n plies (incl. duplicates)"
+		<< "\n- poollatency: measures how quickly the search threads start, stop and get resized"
+		<< "\n- rootmoves: lists the root moves of the last search with their scores, node counts and PVs\n" << endl;
 }
 
 // Perft methods ----------------------------------------------------------------------------------
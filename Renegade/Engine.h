@@ -23,11 +23,15 @@ private:
 	void PrintHeader() const;
 	void HandleDraw(const Position& pos, const uint64_t highlight = 0) const;
 	void HandleBench();
-	void HandleSetOption(const std::vector<std::string>& parts);
+	void HandleBenchPrefetch();
+	void HandleBenchSMP(const std::vector<std::string>& parts);
+	void HandlePoolLatency();
+	void HandleSetOption(const std::vector<std::string>& parts, const std::string& originalInput);
 	void HandlePosition(const std::string originalInput);
 	void HandleGo(const std::vector<std::string>& parts);
 	void HandleHelp() const;
 	void HandleNNUE() const;
+	void HandleEvalBatch(const std::string& originalInput);
 	void HandleCompiler() const;
 	void Perft(Position& position, const int depth, const PerftType type) const;
 	uint64_t PerftRecursive(Position& position, const int depth, const int originalDepth, const PerftType type) const;
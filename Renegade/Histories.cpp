@@ -177,3 +177,40 @@ int16_t Histories::ApplyCorrection(const Position& position, const int16_t rawEv
 	const int correctedEval = rawEval + (pawnCorrection * 231 + lastMoveCorrection * 243 + nonPawnCorrection * 256) / 256 / 256;
 	return std::clamp(correctedEval, -MateThreshold + 1, MateThreshold - 1);
 }
+
+// Prefetching ------------------------------------------------------------------------------------
+
+// Requests the correction history slots the child will read when evaluating, called before the move is made
+// The keys are approximated the same way as the transposition table's: moves involving pawns change the pawn
+// structure, and for those that slot is not prefetched, castling and promotions may fetch the wrong slot
+// Capture history is left out: the move's own slot was already read when the move picker scored it, and the
+// slots the child reads depend on its captures, which aren't known yet
+// Returns the number of slots prefetched
+int Histories::PrefetchForChild(const Position& position, const Move& m, const uint8_t movedPiece, const uint8_t capturedPiece) const {
+#if defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
+	const bool childTurn = !position.Turn();
+	int slots = 0;
+
+	if (position.Moves.size() >= 1) {
+		const MoveAndPiece& prev = position.GetPreviousMove(1);
+		__builtin_prefetch(&FollowUpCorrectionHistory[prev.piece][prev.move.to][movedPiece][m.to]);
+		slots += 1;
+	}
+
+	if (TypeOfPiece(movedPiece) != PieceType::Pawn && TypeOfPiece(capturedPiece) != PieceType::Pawn) {
+		__builtin_prefetch(&PawnCorrectionHistory[childTurn][position.GetPawnHash() % 16384]);
+		slots += 1;
+	}
+
+	auto [whiteNonPawnHash, blackNonPawnHash] = position.GetNonPawnHashes();
+	uint64_t& moverHash = ColorOfPiece(movedPiece) == PieceColor::White ? whiteNonPawnHash : blackNonPawnHash;
+	uint64_t& opponentHash = ColorOfPiece(movedPiece) == PieceColor::White ? blackNonPawnHash : whiteNonPawnHash;
+	if (IsNonPawn(movedPiece)) moverHash ^= Zobrist.PieceSquare[movedPiece][m.from] ^ Zobrist.PieceSquare[movedPiece][m.to];
+	if (capturedPiece != Piece::None && IsNonPawn(capturedPiece)) opponentHash ^= Zobrist.PieceSquare[capturedPiece][m.to];
+	__builtin_prefetch(&NonPawnCorrectionHistory[childTurn][Side::White][whiteNonPawnHash % 65536]);
+	__builtin_prefetch(&NonPawnCorrectionHistory[childTurn][Side::Black][blackNonPawnHash % 65536]);
+	return slots + 2;
+#else
+	return 0;
+#endif
+}
@@ -33,6 +33,9 @@ public:
 	void UpdateCorrection(const Position& position, const int16_t refEval, const int16_t score, const int depth);
 	int16_t ApplyCorrection(const Position& position, const int16_t rawEval) const;
 
+	// Prefetching the entries the child node will read:
+	int PrefetchForChild(const Position& position, const Move& m, const uint8_t movedPiece, const uint8_t capturedPiece) const;
+
 private:
 
 	inline void UpdateHistoryValue(int16_t& value, const int amount, const int cap) {
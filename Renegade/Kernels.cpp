@@ -0,0 +1,16 @@
+#include "Kernels.h"
+#include "KernelsImpl.h"
+
+// For the universal build this file is compiled multiple times with different instruction sets, and
+// only the getter is exported, so it must not depend on the rest of the engine
+
+KernelSet RENEGADE_KERNELS_ENTRY(const std::size_t architecture) {
+	KernelSet kernels{};
+	SupportedArchitectures::ForEach([&]<typename Architecture>(const std::size_t index) {
+		if (index != architecture) return;
+		using K = ArchitectureKernels<Architecture>;
+		kernels = KernelSet{ SIMD::Name, K::Copy, K::Add, K::Sub, K::AddAddAddAdd, K::SubSubSubSub, K::SubAddCopy,
+			K::SubSubAddCopy, K::SubSubAddAddCopy, K::MultiUpdateCopy, K::SCReLUOutput };
+	});
+	return kernels;
+}
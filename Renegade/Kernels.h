@@ -0,0 +1,108 @@
+#pragma once
+#include "Architecture.h"
+#include "Simd.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Set of NNUE kernels compiled for a given instruction set and network architecture
+// For the universal build Kernels.cpp is built once per target, each build exposing its own getter,
+// and the engine calls the kernels through the selected set (a single indirect call per update)
+// The getters take the index of the architecture in SupportedArchitectures
+
+struct KernelSet {
+	std::string_view Name;
+	void (*Copy)(int16_t* acc, const int16_t* src);
+	void (*Add)(int16_t* acc, const FeatureWeight* a1);
+	void (*Sub)(int16_t* acc, const FeatureWeight* s1);
+	void (*AddAddAddAdd)(int16_t* acc, const FeatureWeight* a1, const FeatureWeight* a2, const FeatureWeight* a3, const FeatureWeight* a4);
+	void (*SubSubSubSub)(int16_t* acc, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* s3, const FeatureWeight* s4);
+	void (*SubAddCopy)(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* a1);
+	void (*SubSubAddCopy)(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* a1);
+	void (*SubSubAddAddCopy)(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* a1, const FeatureWeight* a2);
+	void (*MultiUpdateCopy)(int16_t* out, const int16_t* in, const FeatureWeight* const* subs, const int subCount,
+		const FeatureWeight* const* adds, const int addCount);
+	int32_t (*SCReLUOutput)(const int16_t* friendly, const int16_t* opponent, const int16_t* weights);
+};
+
+KernelSet GetKernelsScalar(const std::size_t architecture);
+KernelSet GetKernelsSSE2(const std::size_t architecture);
+KernelSet GetKernelsAVX2(const std::size_t architecture);
+KernelSet GetKernelsAVX512(const std::size_t architecture);
+KernelSet GetKernelsAVX512VNNI(const std::size_t architecture);
+
+// The getter matching the instruction set of the current translation unit
+#if defined(RENEGADE_SIMD_AVX512) && defined(__AVX512VNNI__)
+#define RENEGADE_KERNELS_ENTRY GetKernelsAVX512VNNI
+#elif defined(RENEGADE_SIMD_AVX512)
+#define RENEGADE_KERNELS_ENTRY GetKernelsAVX512
+#elif defined(RENEGADE_SIMD_AVX2)
+#define RENEGADE_KERNELS_ENTRY GetKernelsAVX2
+#elif defined(RENEGADE_SIMD_SSE)
+#define RENEGADE_KERNELS_ENTRY GetKernelsSSE2
+#else
+#define RENEGADE_KERNELS_ENTRY GetKernelsScalar
+#endif
+
+#if defined(RENEGADE_DISPATCH)
+
+extern KernelSet Kernels;
+
+#else
+
+#include "KernelsImpl.h"
+
+// With a fixed instruction set the kernels are called directly so that they can be inlined, only the
+// architecture of the network is picked at runtime (a branch that is always predicted correctly)
+struct DirectKernels {
+	std::string_view Name = SIMD::Name;
+	std::size_t Architecture = DefaultArchitectureIndex;
+
+	template <typename Function>
+	inline void Call(Function&& function) const {
+		SupportedArchitectures::ForEach([&]<typename Arch>(const std::size_t index) {
+			if (index == Architecture) function.template operator()<Arch>();
+		});
+	}
+
+	inline void Copy(int16_t* acc, const int16_t* src) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::Copy(acc, src); });
+	}
+	inline void Add(int16_t* acc, const FeatureWeight* a1) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::Add(acc, a1); });
+	}
+	inline void Sub(int16_t* acc, const FeatureWeight* s1) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::Sub(acc, s1); });
+	}
+	inline void AddAddAddAdd(int16_t* acc, const FeatureWeight* a1, const FeatureWeight* a2, const FeatureWeight* a3, const FeatureWeight* a4) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::AddAddAddAdd(acc, a1, a2, a3, a4); });
+	}
+	inline void SubSubSubSub(int16_t* acc, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* s3, const FeatureWeight* s4) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::SubSubSubSub(acc, s1, s2, s3, s4); });
+	}
+	inline void SubAddCopy(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* a1) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::SubAddCopy(out, in, s1, a1); });
+	}
+	inline void SubSubAddCopy(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* a1) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::SubSubAddCopy(out, in, s1, s2, a1); });
+	}
+	inline void SubSubAddAddCopy(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* a1, const FeatureWeight* a2) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::SubSubAddAddCopy(out, in, s1, s2, a1, a2); });
+	}
+	inline void MultiUpdateCopy(int16_t* out, const int16_t* in, const FeatureWeight* const* subs, const int subCount,
+		const FeatureWeight* const* adds, const int addCount) const {
+		Call([&]<typename Arch>() { ArchitectureKernels<Arch>::MultiUpdateCopy(out, in, subs, subCount, adds, addCount); });
+	}
+	inline int32_t SCReLUOutput(const int16_t* friendly, const int16_t* opponent, const int16_t* weights) const {
+		int32_t output = 0;
+		Call([&]<typename Arch>() { output = ArchitectureKernels<Arch>::SCReLUOutput(friendly, opponent, weights); });
+		return output;
+	}
+};
+
+extern DirectKernels Kernels;
+
+#endif
+
+void SelectKernels();
+void UpdateKernels(const std::size_t architecture);
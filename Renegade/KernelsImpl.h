@@ -0,0 +1,162 @@
+#pragma once
+#include "Architecture.h"
+#include "Simd.h"
+#include <cstdint>
+
+// Kernels for the accumulator updates and the output layer
+// These are the hottest loops of the engine, written with the wrappers of Simd.h
+// Everything is in an anonymous namespace like in Simd.h, so each translation unit gets its own copy
+// for the instruction set it is compiled with: the universal build includes this only in Kernels.cpp,
+// while fixed instruction set builds call the kernels directly through Kernels.h
+
+namespace {
+
+	// Loads a vector of feature weights, widening them to the accumulator's type if stored as int8
+	inline SIMD::VecI16 LoadWeights(const FeatureWeight* p) {
+#if defined(RENEGADE_INT8_WEIGHTS)
+		return SIMD::ShiftLeft16(SIMD::Load8As16(p), FeatureWeightShift);
+#else
+		return SIMD::Load16(p);
+#endif
+	}
+
+	// The work of the fused kernels is split into tiles of a few vectors, that are kept in registers while
+	// all rows are applied: this is the largest tile of at most 10 vectors (that fits in the register file
+	// of every target) dividing the hidden layer evenly
+	constexpr int TileSize(const int vecCount) {
+		for (int tile = 10; tile > 1; tile--) {
+			if (vecCount % tile == 0) return tile;
+		}
+		return 1;
+	}
+
+	// Kernels for an architecture, the loop bounds are compile-time constants, so these are fully unrolled
+	template <typename Architecture>
+	struct ArchitectureKernels {
+
+		static constexpr int HiddenSize = Architecture::HiddenSize;
+		static constexpr int VecCount = HiddenSize / SIMD::I16PerVec;
+		static_assert(HiddenSize % SIMD::I16PerVec == 0);
+
+		static void Copy(int16_t* acc, const int16_t* src) {
+			for (int i = 0; i < VecCount; i++) {
+				SIMD::Store16(&acc[i * SIMD::I16PerVec], SIMD::Load16(&src[i * SIMD::I16PerVec]));
+			}
+		}
+
+		static void Add(int16_t* acc, const FeatureWeight* a1) {
+			for (int i = 0; i < VecCount; i++) {
+				const int offset = i * SIMD::I16PerVec;
+				SIMD::Store16(&acc[offset], SIMD::Add16(SIMD::Load16(&acc[offset]), LoadWeights(&a1[offset])));
+			}
+		}
+
+		static void Sub(int16_t* acc, const FeatureWeight* s1) {
+			for (int i = 0; i < VecCount; i++) {
+				const int offset = i * SIMD::I16PerVec;
+				SIMD::Store16(&acc[offset], SIMD::Sub16(SIMD::Load16(&acc[offset]), LoadWeights(&s1[offset])));
+			}
+		}
+
+		// Fused copy-and-update kernels: these read the parent accumulator and the weight rows once, and
+		// write the child accumulator once, instead of copying first and then updating in place
+
+		static constexpr int TileVecs = TileSize(VecCount);
+
+		// The row counts are template parameters for the common cases, so the loops are fully unrolled,
+		// while -1 means the counts are only known at runtime
+		template<int SubCount, int AddCount>
+		static inline void FusedUpdate(int16_t* out, const int16_t* in, const FeatureWeight* const* subs, int subCount,
+			const FeatureWeight* const* adds, int addCount) {
+			if constexpr (SubCount != -1) subCount = SubCount;
+			if constexpr (AddCount != -1) addCount = AddCount;
+
+			for (int t = 0; t < VecCount; t += TileVecs) {
+				SIMD::VecI16 regs[TileVecs];
+				for (int i = 0; i < TileVecs; i++) {
+					regs[i] = SIMD::Load16(&in[(t + i) * SIMD::I16PerVec]);
+				}
+				for (int s = 0; s < subCount; s++) {
+					for (int i = 0; i < TileVecs; i++) {
+						regs[i] = SIMD::Sub16(regs[i], LoadWeights(&subs[s][(t + i) * SIMD::I16PerVec]));
+					}
+				}
+				for (int a = 0; a < addCount; a++) {
+					for (int i = 0; i < TileVecs; i++) {
+						regs[i] = SIMD::Add16(regs[i], LoadWeights(&adds[a][(t + i) * SIMD::I16PerVec]));
+					}
+				}
+				for (int i = 0; i < TileVecs; i++) {
+					SIMD::Store16(&out[(t + i) * SIMD::I16PerVec], regs[i]);
+				}
+			}
+		}
+
+		static void SubAddCopy(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* a1) {
+			const FeatureWeight* subs[] = { s1 };
+			const FeatureWeight* adds[] = { a1 };
+			FusedUpdate<1, 1>(out, in, subs, 1, adds, 1);
+		}
+
+		static void SubSubAddCopy(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* a1) {
+			const FeatureWeight* subs[] = { s1, s2 };
+			const FeatureWeight* adds[] = { a1 };
+			FusedUpdate<2, 1>(out, in, subs, 2, adds, 1);
+		}
+
+		static void SubSubAddAddCopy(int16_t* out, const int16_t* in, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* a1, const FeatureWeight* a2) {
+			const FeatureWeight* subs[] = { s1, s2 };
+			const FeatureWeight* adds[] = { a1, a2 };
+			FusedUpdate<2, 2>(out, in, subs, 2, adds, 2);
+		}
+
+		// Variable number of rows, used for catching up over multiple plies at once
+		static void MultiUpdateCopy(int16_t* out, const int16_t* in, const FeatureWeight* const* subs, const int subCount,
+			const FeatureWeight* const* adds, const int addCount) {
+			FusedUpdate<-1, -1>(out, in, subs, subCount, adds, addCount);
+		}
+
+		static void AddAddAddAdd(int16_t* acc, const FeatureWeight* a1, const FeatureWeight* a2, const FeatureWeight* a3, const FeatureWeight* a4) {
+			for (int i = 0; i < VecCount; i++) {
+				const int offset = i * SIMD::I16PerVec;
+				SIMD::VecI16 v = SIMD::Load16(&acc[offset]);
+				v = SIMD::Add16(v, SIMD::Add16(LoadWeights(&a1[offset]), LoadWeights(&a2[offset])));
+				v = SIMD::Add16(v, SIMD::Add16(LoadWeights(&a3[offset]), LoadWeights(&a4[offset])));
+				SIMD::Store16(&acc[offset], v);
+			}
+		}
+
+		static void SubSubSubSub(int16_t* acc, const FeatureWeight* s1, const FeatureWeight* s2, const FeatureWeight* s3, const FeatureWeight* s4) {
+			for (int i = 0; i < VecCount; i++) {
+				const int offset = i * SIMD::I16PerVec;
+				SIMD::VecI16 v = SIMD::Load16(&acc[offset]);
+				v = SIMD::Sub16(v, SIMD::Add16(LoadWeights(&s1[offset]), LoadWeights(&s2[offset])));
+				v = SIMD::Sub16(v, SIMD::Add16(LoadWeights(&s3[offset]), LoadWeights(&s4[offset])));
+				SIMD::Store16(&acc[offset], v);
+			}
+		}
+
+		// Output layer with SCReLU activation, returns the sum of clamp(x, 0, QA)^2 * w over both perspectives
+		// Idea by somelizard: computing (x * w) * x with 16-bit multiplication and pairwise adds makes fast QA=255
+		// SCReLU possible, it requires the product of the clamped activation and the weight to fit into 16 bits
+		static int32_t SCReLUOutput(const int16_t* friendly, const int16_t* opponent, const int16_t* weights) {
+			const SIMD::VecI16 min = SIMD::Zero();
+			const SIMD::VecI16 max = SIMD::Set16(static_cast<int16_t>(Architecture::QA));
+			SIMD::VecI32 sum = SIMD::Zero();
+
+			for (int i = 0; i < VecCount; i++) {
+				const int offset = i * SIMD::I16PerVec;
+				const SIMD::VecI16 v = SIMD::Min16(SIMD::Max16(SIMD::Load16(&friendly[offset]), min), max);
+				const SIMD::VecI16 w = SIMD::Load16(&weights[offset]);
+				sum = SIMD::MulAddPairs16(sum, v, SIMD::MulLo16(v, w));
+			}
+			for (int i = 0; i < VecCount; i++) {
+				const int offset = i * SIMD::I16PerVec;
+				const SIMD::VecI16 v = SIMD::Min16(SIMD::Max16(SIMD::Load16(&opponent[offset]), min), max);
+				const SIMD::VecI16 w = SIMD::Load16(&weights[offset + HiddenSize]);
+				sum = SIMD::MulAddPairs16(sum, v, SIMD::MulLo16(v, w));
+			}
+			return SIMD::ReduceAdd32(sum);
+		}
+	};
+}
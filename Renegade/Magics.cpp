@@ -3,22 +3,74 @@
 // Largely based on https://github.com/maksimKorzh/chess_programming/blob/master/src/magics/magics.c
 // and indirectly on https://www.chessprogramming.org/Looking_for_Magics#Feeding_in_Randoms
 
+// Attack lookup tables (generated at runtime)
+static MultiArray<uint64_t, 64, 4096> RookAttacks;
+static MultiArray<uint64_t, 64, 512> BishopAttacks;
+static MultiArray<uint64_t, 64, 64> ShortConnectingRays;
+static MultiArray<uint64_t, 64, 64> LongConnectingRays;
+
+// Slider lookup indices --------------------------------------------------------------------------
+// With BMI2 the relevant occupancy bits can be extracted directly using pext, which is faster than
+// the magic multiplication on most CPUs. Fixed BMI2 builds always use it, the universal build decides
+// at startup in GenerateMagicTables()
+
+#if defined(__BMI2__) && !defined(RENEGADE_DISPATCH)
+
+#include <immintrin.h>
+static constexpr bool UsePext = true;
+
+static inline uint64_t Pext(const uint64_t bits, const uint64_t mask) {
+	return _pext_u64(bits, mask);
+}
+
+#elif defined(RENEGADE_DISPATCH)
+
+#include <immintrin.h>
+static bool UsePext = false;
+
+#if defined(__BMI2__)
+static inline uint64_t Pext(const uint64_t bits, const uint64_t mask) {
+	return _pext_u64(bits, mask);
+}
+#else
+__attribute__((target("bmi2"))) static uint64_t Pext(const uint64_t bits, const uint64_t mask) {
+	return _pext_u64(bits, mask);
+}
+#endif
+
+#else
+
+static constexpr bool UsePext = false;
+static inline uint64_t Pext(const uint64_t, const uint64_t) { return 0; }
+
+#endif
+
+static inline int RookIndex(const uint8_t square, const uint64_t occupancy) {
+	if (UsePext) return static_cast<int>(Pext(occupancy, RookMasks[square]));
+	return static_cast<int>(((occupancy & RookMasks[square]) * RookMagicNumbers[square]) >> (64 - RookRelevantBits[square]));
+}
+
+static inline int BishopIndex(const uint8_t square, const uint64_t occupancy) {
+	if (UsePext) return static_cast<int>(Pext(occupancy, BishopMasks[square]));
+	return static_cast<int>(((occupancy & BishopMasks[square]) * BishopMagicNumbers[square]) >> (64 - BishopRelevantBits[square]));
+}
+
+std::string_view GetSliderLookupMethod() {
+	return UsePext ? "pext" : "magic";
+}
+
 // Retrieving attack bitboards --------------------------------------------------------------------
 
 uint64_t GetRookAttacks(const uint8_t square, const uint64_t occupancy) {
-	const int index = static_cast<int>(((occupancy & RookMasks[square]) * RookMagicNumbers[square]) >> (64 - RookRelevantBits[square]));
-	return RookAttacks[square][index];
+	return RookAttacks[square][RookIndex(square, occupancy)];
 }
 
 uint64_t GetBishopAttacks(const uint8_t square, const uint64_t occupancy) {
-	const int index = static_cast<int>(((occupancy & BishopMasks[square]) * BishopMagicNumbers[square]) >> (64 - BishopRelevantBits[square]));
-	return BishopAttacks[square][index];
+	return BishopAttacks[square][BishopIndex(square, occupancy)];
 }
 
 uint64_t GetQueenAttacks(const uint8_t square, const uint64_t occupancy) {
-	const int rookIndex = static_cast<int>(((occupancy & RookMasks[square]) * RookMagicNumbers[square]) >> (64 - RookRelevantBits[square]));
-	const int bishopIndex = static_cast<int>(((occupancy & BishopMasks[square]) * BishopMagicNumbers[square]) >> (64 - BishopRelevantBits[square]));
-	return BishopAttacks[square][bishopIndex] | RookAttacks[square][rookIndex];
+	return BishopAttacks[square][BishopIndex(square, occupancy)] | RookAttacks[square][RookIndex(square, occupancy)];
 }
 
 uint64_t GetShortConnectingRay(const uint8_t from, const uint8_t to) {
@@ -111,12 +163,17 @@ static uint64_t DynamicBishopAttacks(const int square, const uint64_t blockers)
 
 void GenerateMagicTables() {
 
+	// 0. Decide the lookup method, the tables are indexed differently
+#if defined(RENEGADE_DISPATCH)
+	const CpuFeatures& cpu = GetCpuFeatures();
+	UsePext = cpu.BMI2 && cpu.FastPext;
+#endif
+
 	// 1. Populate rook magic results
 	for (int sq = 0; sq < 64; sq++) {
 		for (int i = 0; i < 4096; i++) {
 			const uint64_t occ = GenerateMagicOccupancy(i, RookMasks[sq]);
-			const int index = static_cast<int>((occ * RookMagicNumbers[sq]) >> (64 - RookRelevantBits[sq]));
-			RookAttacks[sq][index] = DynamicRookAttacks(sq, occ);
+			RookAttacks[sq][RookIndex(sq, occ)] = DynamicRookAttacks(sq, occ);
 		}
 	}
 
@@ -124,8 +181,7 @@ void GenerateMagicTables() {
 	for (int sq = 0; sq < 64; sq++) {
 		for (int i = 0; i < 512; i++) {
 			const uint64_t occ = GenerateMagicOccupancy(i, BishopMasks[sq]);
-			const int index = static_cast<int>((occ * BishopMagicNumbers[sq]) >> (64 - BishopRelevantBits[sq]));
-			BishopAttacks[sq][index] = DynamicBishopAttacks(sq, occ);
+			BishopAttacks[sq][BishopIndex(sq, occ)] = DynamicBishopAttacks(sq, occ);
 		}
 	}
 
@@ -8,12 +8,7 @@ extern uint64_t GetBishopAttacks(const uint8_t square, const uint64_t occupancy)
 extern uint64_t GetQueenAttacks(const uint8_t square, const uint64_t occupancy);
 extern uint64_t GetShortConnectingRay(const uint8_t from, const uint8_t to);
 extern uint64_t GetLongConnectingRay(const uint8_t from, const uint8_t to);
-
-// Attack lookup tables (generated at runtime)
-static MultiArray<uint64_t, 64, 4096> RookAttacks;
-static MultiArray<uint64_t, 64, 512> BishopAttacks;
-static MultiArray<uint64_t, 64, 64> ShortConnectingRays;
-static MultiArray<uint64_t, 64, 64> LongConnectingRays;
+extern std::string_view GetSliderLookupMethod();
 
 // Pregenerated random magic numbers
 // Think of: https://xkcd.com/221/
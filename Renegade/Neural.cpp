@@ -1,5 +1,14 @@
 #include "Neural.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_MSC_VER) || defined(_WIN32)
+#include <malloc.h>
+#endif
+
 // Incbin shenanigans
 
 #ifdef _MSC_VER
@@ -15,20 +24,108 @@
 #undef RENEGADE_MSVC
 #endif
 
+// Validating network files ----------------------------------------------------------------------
+
+// Sum of the 64-bit words of the payload, each multiplied by a distinct odd number
+// Cheap enough to run on every load, and simple to replicate with numpy in the converter script
+uint64_t NetworkChecksum(const char* data, const std::size_t size) {
+	uint64_t checksum = 0;
+	for (std::size_t i = 0; i < size / 8; i++) {
+		uint64_t word;
+		std::memcpy(&word, data + i * 8, 8);
+		checksum += word * (2 * i + 1);
+	}
+	return checksum;
+}
+
+// Checks whether the network file matches one of the architectures compiled into the engine
+// Returns where the network data starts within the file and its architecture, or nothing if the file can't be used
+std::optional<NetworkFileInfo> ValidateNetwork(const char* data, const std::size_t size, const std::string_view name, const bool allowRaw) {
+	const auto reject = [&](const std::string_view reason) {
+		cout << "info string Invalid network '" << name << "': " << reason << endl;
+		return std::optional<NetworkFileInfo>(std::nullopt);
+	};
+
+	if (size < sizeof(NetworkHeader) || std::memcmp(data, NetworkMagic.data(), NetworkMagic.size()) != 0) {
+		// Headerless files are only accepted if the layout is the trainer's
+		if (!allowRaw) return reject("missing header (convert it with Python/ConvertNetwork.py)");
+		if constexpr (!std::is_same_v<FeatureWeight, int16_t>) return reject("expected a converted int8 network with a header");
+		if (size != sizeof(NetworkRepresentation<DefaultArchitecture>)) return reject("unexpected size");
+		return NetworkFileInfo{ 0, DefaultArchitectureIndex };
+	}
+
+	NetworkHeader header;
+	std::memcpy(&header, data, sizeof(NetworkHeader));
+	if (header.Version != NetworkFormatVersion) return reject("unsupported format version");
+	if (header.FeatureWeightBits != sizeof(FeatureWeight) * 8 || header.FeatureWeightShift != FeatureWeightShift) {
+		return reject("feature weight quantization doesn't match this build");
+	}
+
+	std::optional<std::size_t> architecture, expectedSize;
+	SupportedArchitectures::ForEach([&]<typename Architecture>(const std::size_t index) {
+		if (architecture.has_value()) return;
+		if (header.FeatureSize == FeatureSize && header.HiddenSize == Architecture::HiddenSize
+			&& header.InputBucketCount == Architecture::InputBucketCount && header.OutputBucketCount == Architecture::OutputBucketCount
+			&& header.QA == Architecture::QA && header.QB == Architecture::QB && header.Scale == Architecture::Scale) {
+			architecture = index;
+			expectedSize = sizeof(NetworkRepresentation<Architecture>);
+		}
+	});
+	if (!architecture.has_value()) return reject("architecture isn't supported by this build");
+
+	if (header.PayloadSize != expectedSize.value() || size < sizeof(NetworkHeader) + header.PayloadSize) {
+		return reject("unexpected size");
+	}
+	if (NetworkChecksum(data + sizeof(NetworkHeader), header.PayloadSize) != header.Checksum) {
+		return reject("checksum mismatch");
+	}
+	return NetworkFileInfo{ sizeof(NetworkHeader), architecture.value() };
+}
+
+NetworkView MakeNetworkView(const char* data, const std::size_t architectureIndex) {
+	NetworkView view{};
+	SupportedArchitectures::ForEach([&]<typename Architecture>(const std::size_t index) {
+		if (index == architectureIndex) view = MakeNetworkView<Architecture>(data, index);
+	});
+	return view;
+}
+
 // Loading the neural network ---------------------------------------------------------------------
 
+static void ActivateNetwork(const NetworkView& selected);
+
 #if !defined(_MSC_VER) || defined(__clang__)
 
 #undef INCBIN_ALIGNMENT
 #define INCBIN_ALIGNMENT 64
 INCBIN(DefaultNetwork, NETWORK_NAME);
-const NetworkRepresentation* Network = reinterpret_cast<const NetworkRepresentation*>(gDefaultNetworkData);
-void LoadDefaultNetwork() {}
+NetworkView Network = MakeNetworkView<DefaultArchitecture>(reinterpret_cast<const char*>(gDefaultNetworkData), DefaultArchitectureIndex);
+static NetworkView DefaultNetwork = Network;
+
+void LoadDefaultNetwork() {
+	const char* data = reinterpret_cast<const char*>(gDefaultNetworkData);
+	const std::optional<NetworkFileInfo> info = ValidateNetwork(data, gDefaultNetworkSize, NETWORK_NAME, true);
+	if (!info.has_value()) std::terminate();
+	DefaultNetwork = MakeNetworkView(data + info->Offset, info->ArchitectureIndex);
+	ActivateNetwork(DefaultNetwork);
+}
 
 #else
 
-const NetworkRepresentation* Network;
-std::unique_ptr<NetworkRepresentation> ExternalNetwork;
+// Heap allocated networks are kept in 64-byte aligned blocks, as the kernels use aligned loads
+struct alignas(64) NetworkBlock {
+	std::array<char, 64> bytes;
+};
+
+static std::unique_ptr<NetworkBlock[]> CopyNetworkData(const char* data, const std::size_t size) {
+	std::unique_ptr<NetworkBlock[]> blocks = std::make_unique<NetworkBlock[]>((size + 63) / 64);
+	std::memcpy(blocks.get(), data, size);
+	return blocks;
+}
+
+NetworkView Network;
+static NetworkView DefaultNetwork;
+std::unique_ptr<NetworkBlock[]> ExternalNetwork;
 
 void LoadDefaultNetwork() {
 	std::ifstream ifs(NETWORK_NAME, std::ios::binary);
@@ -37,10 +134,14 @@ void LoadDefaultNetwork() {
 		std::terminate();
 	}
 
-	std::unique_ptr<NetworkRepresentation> loadedNetwork = std::make_unique<NetworkRepresentation>();
-	ifs.read((char*)loadedNetwork.get(), sizeof(NetworkRepresentation));
-	std::swap(ExternalNetwork, loadedNetwork);
-	Network = ExternalNetwork.get();
+	const std::vector<char> contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	const std::optional<NetworkFileInfo> info = ValidateNetwork(contents.data(), contents.size(), NETWORK_NAME, true);
+	if (!info.has_value()) std::terminate();
+
+	const NetworkView layout = MakeNetworkView(contents.data() + info->Offset, info->ArchitectureIndex);
+	ExternalNetwork = CopyNetworkData(layout.Data, layout.Size);
+	DefaultNetwork = MakeNetworkView(reinterpret_cast<const char*>(ExternalNetwork.get()), info->ArchitectureIndex);
+	ActivateNetwork(DefaultNetwork);
 
 	const int startposEval = NeuralEvaluate(Position());
 	if (std::abs(startposEval) < 300 && startposEval != 0) cout << "Loaded '" << NETWORK_NAME << "' network from disk probably successfully";
@@ -50,68 +151,287 @@ void LoadDefaultNetwork() {
 
 #endif
 
+// Placing the network in memory ------------------------------------------------------------------
+// The feature weights are read at random rows, which with 4 KB pages means lots of TLB misses
+// Optionally the selected network is copied into a buffer backed by 2 MB pages, and/or locked in memory
+// (locking alone also uses a copy, as the original may be a file mapping), writing the copy also prefaults
+// every page, so the first search doesn't pay for the page faults
+
+struct NetworkCopy {
+	char* address = nullptr;
+	std::size_t size = 0;
+	bool locked = false;
+};
+
+static NetworkView SelectedNetwork{};  // embedded or loaded from a file
+static NetworkCopy NetworkInMemory;
+static bool UseHugePageCopy = false;
+static bool LockNetworkCopy = false;
+
+static void FreeNetworkCopy(NetworkCopy& copy) {
+	if (copy.address == nullptr) return;
+#if defined(_MSC_VER) || defined(_WIN32)
+	_aligned_free(copy.address);
+#else
+	if (copy.locked) munlock(copy.address, copy.size);
+	std::free(copy.address);
+#endif
+	copy = {};
+}
+
+static char* AllocateNetworkCopy(const std::size_t size) {
+#if defined(_MSC_VER) || defined(_WIN32)
+	return static_cast<char*>(_aligned_malloc(size, 2 * 1024 * 1024));
+#else
+	return static_cast<char*>(std::aligned_alloc(2 * 1024 * 1024, size));
+#endif
+}
+
+static void PlaceNetwork(const NetworkView& selected) {
+	SelectedNetwork = selected;
+	Network = selected;
+	UpdateKernels(selected.ArchitectureIndex);
+	FreeNetworkCopy(NetworkInMemory);
+	if (!UseHugePageCopy && !LockNetworkCopy) return;
+
+	constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+	const std::size_t size = (selected.Size + hugePageSize - 1) / hugePageSize * hugePageSize;
+	char* copy = AllocateNetworkCopy(size);
+	if (copy == nullptr) {
+		cout << "info string Failed to allocate memory for the network copy, using the original" << endl;
+		return;
+	}
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (UseHugePageCopy) madvise(copy, size, MADV_HUGEPAGE);
+#endif
+	std::memcpy(copy, selected.Data, selected.Size);
+
+	bool locked = false;
+#if defined(__unix__) || defined(__APPLE__)
+	if (LockNetworkCopy) {
+		locked = mlock(copy, size) == 0;
+		if (!locked) cout << "info string Failed to lock the network in memory (check the memlock limit)" << endl;
+	}
+#endif
+
+	NetworkInMemory = { copy, size, locked };
+	Network = MakeNetworkView(copy, selected.ArchitectureIndex);
+}
+
+// NUMA replicas: with the replicate policy each node gets a copy of the network in its local memory,
+// so the weight rows read by the accumulator updates don't have to cross sockets
+// Threads pick the copy of their node at the start of each search, the views of nodes without a replica
+// are the same as the primary network, so they stay valid regardless of the setting
+
+static std::array<NetworkCopy, Numa::MaxNodes> NodeReplicas;
+static std::array<NetworkView, Numa::MaxNodes> NodeNetworks;
+static bool UseNodeReplicas = false;
+
+static void CreateNodeReplicas() {
+	for (int node = 0; node < Numa::MaxNodes; node++) {
+		FreeNetworkCopy(NodeReplicas[node]);
+		NodeNetworks[node] = Network;
+	}
+	if (!UseNodeReplicas || Numa::NodeCount() == 1) return;
+
+	constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+	const std::size_t size = (Network.Size + hugePageSize - 1) / hugePageSize * hugePageSize;
+	for (int node = 0; node < Numa::NodeCount(); node++) {
+		char* copy = AllocateNetworkCopy(size);
+		if (copy == nullptr) {
+			cout << "info string Failed to allocate memory for the network replica of node " << node << endl;
+			continue;
+		}
+		// The placement must be set before copying, which is what faults the pages in
+		Numa::BindMemory(copy, size, node);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		if (UseHugePageCopy) madvise(copy, size, MADV_HUGEPAGE);
+#endif
+		std::memcpy(copy, Network.Data, Network.Size);
+		NodeReplicas[node] = { copy, size, false };
+		NodeNetworks[node] = MakeNetworkView(copy, Network.ArchitectureIndex);
+	}
+}
+
+// Makes the given network the one used for evaluation, either directly or through a copy
+// This also switches the kernels to the ones of the network's architecture
+static void ActivateNetwork(const NetworkView& selected) {
+	PlaceNetwork(selected);
+	CreateNodeReplicas();
+}
+
+void SetNetworkReplication(const bool enabled) {
+	UseNodeReplicas = enabled;
+	CreateNodeReplicas();
+}
+
+const NetworkView& NetworkForNode(const int node) {
+	return NodeNetworks[node];
+}
+
+void SetNetworkMemoryOptions(const bool hugePages, const bool lock) {
+	UseHugePageCopy = hugePages;
+	LockNetworkCopy = lock;
+	ActivateNetwork(SelectedNetwork.Data != nullptr ? SelectedNetwork : Network);
+}
+
+std::string DescribeNetworkMemory() {
+	const int replicas = static_cast<int>(std::ranges::count_if(NodeReplicas, [](const NetworkCopy& copy) { return copy.address != nullptr; }));
+	const std::string replicaText = replicas == 0 ? "" : ", " + std::to_string(replicas) + " NUMA node replicas";
+	if (NetworkInMemory.address == nullptr) return "original location" + replicaText;
+	return std::string(UseHugePageCopy ? "copy with 2 MB pages requested (" : "copy (") + Console::FormatInteger(NetworkInMemory.size) + " bytes"
+		+ (NetworkInMemory.locked ? ", locked)" : ")") + replicaText;
+}
+
+// Loading networks at runtime (EvalFile) ---------------------------------------------------------
+// On POSIX systems the file is memory mapped read-only, so engine processes using the same network
+// share the page cache, elsewhere it's simply read into memory
+// Switching networks is only safe while no search is running, the caller needs to ensure that
+// The file may contain any of the supported architectures, the kernels are switched accordingly
+
+#if defined(__unix__) || defined(__APPLE__)
+
+struct MappedNetworkFile {
+	void* address = nullptr;
+	std::size_t size = 0;
+};
+static MappedNetworkFile LoadedNetworkFile;
+
+static void ReleaseLoadedNetwork() {
+	if (LoadedNetworkFile.address != nullptr) munmap(LoadedNetworkFile.address, LoadedNetworkFile.size);
+	LoadedNetworkFile = {};
+}
+
+bool LoadNetworkFromFile(const std::string& path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		cout << "info string Failed to open network '" << path << "'" << endl;
+		return false;
+	}
+	struct stat fileStats;
+	if (fstat(fd, &fileStats) != 0 || fileStats.st_size == 0) {
+		close(fd);
+		cout << "info string Failed to read network '" << path << "'" << endl;
+		return false;
+	}
+	const std::size_t size = static_cast<std::size_t>(fileStats.st_size);
+	void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED) {
+		cout << "info string Failed to map network '" << path << "'" << endl;
+		return false;
+	}
+
+	const std::optional<NetworkFileInfo> info = ValidateNetwork(static_cast<const char*>(address), size, path, false);
+	if (!info.has_value()) {
+		munmap(address, size);
+		return false;
+	}
+
+	// The previous file is no longer referenced after the switch, it can be unmapped
+	ActivateNetwork(MakeNetworkView(static_cast<const char*>(address) + info->Offset, info->ArchitectureIndex));
+	ReleaseLoadedNetwork();
+	LoadedNetworkFile = { address, size };
+	cout << "info string Loaded network '" << path << "' (" << Network.ArchitectureName << " architecture, "
+		<< Console::FormatInteger(size) << " bytes, mapped)" << endl;
+	return true;
+}
+
+#else
+
+static std::unique_ptr<NetworkBlock[]> LoadedNetwork;
+
+static void ReleaseLoadedNetwork() {
+	LoadedNetwork.reset();
+}
+
+bool LoadNetworkFromFile(const std::string& path) {
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs) {
+		cout << "info string Failed to open network '" << path << "'" << endl;
+		return false;
+	}
+
+	const std::vector<char> contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	const std::optional<NetworkFileInfo> info = ValidateNetwork(contents.data(), contents.size(), path, false);
+	if (!info.has_value()) return false;
+
+	const NetworkView layout = MakeNetworkView(contents.data() + info->Offset, info->ArchitectureIndex);
+	std::unique_ptr<NetworkBlock[]> loadedNetwork = CopyNetworkData(layout.Data, layout.Size);
+	ActivateNetwork(MakeNetworkView(reinterpret_cast<const char*>(loadedNetwork.get()), info->ArchitectureIndex));
+	std::swap(LoadedNetwork, loadedNetwork);
+	cout << "info string Loaded network '" << path << "' (" << Network.ArchitectureName << " architecture, "
+		<< Console::FormatInteger(contents.size()) << " bytes)" << endl;
+	return true;
+}
+
+#endif
+
+void RestoreDefaultNetwork() {
+	ActivateNetwork(DefaultNetwork);
+	ReleaseLoadedNetwork();
+}
+
+// Selecting the kernels -------------------------------------------------------------------------
+
+#if defined(RENEGADE_DISPATCH)
+
+static KernelSet (*KernelGetter)(const std::size_t) = RENEGADE_KERNELS_ENTRY;
+KernelSet Kernels = RENEGADE_KERNELS_ENTRY(DefaultArchitectureIndex);
+
+// For the universal build the kernels for each instruction set are linked in, and the fastest one
+// supported by the CPU is picked at startup
+void SelectKernels() {
+	const CpuFeatures& cpu = GetCpuFeatures();
+	if (cpu.AVX512F && cpu.AVX512BW && cpu.AVX512VNNI) KernelGetter = GetKernelsAVX512VNNI;
+	else if (cpu.AVX512F && cpu.AVX512BW) KernelGetter = GetKernelsAVX512;
+	else if (cpu.AVX2) KernelGetter = GetKernelsAVX2;
+	else KernelGetter = GetKernelsSSE2;  // part of the x86-64 baseline
+	UpdateKernels(Network.ArchitectureIndex);
+}
+
+// Called when the architecture of the network in use changes
+void UpdateKernels(const std::size_t architecture) {
+	Kernels = KernelGetter(architecture);
+}
+
+#else
+
+// Otherwise the compile-time kernels are called directly, only the architecture needs to be tracked
+DirectKernels Kernels;
+
+void SelectKernels() {
+	UpdateKernels(Network.ArchitectureIndex);
+}
+
+void UpdateKernels(const std::size_t architecture) {
+	Kernels.Architecture = architecture;
+}
+
+#endif
+
 // Evaluating the position ------------------------------------------------------------------------
 
-int16_t NeuralEvaluate(const Position& position, const AccumulatorRepresentation& acc) {
+// Output of the network before any scaling, this is what the evaluation cache stores
+int32_t NetworkOutput(const Position& position, const AccumulatorRepresentation& acc, const NetworkView& net) {
 	assert(acc.Correct[Side::White] && acc.Correct[Side::Black]);
 
 	const bool turn = position.Turn();
-	const std::array<int16_t, HiddenSize>& hiddenFriendly = acc.Accumulator[turn];
-	const std::array<int16_t, HiddenSize>& hiddenOpponent = acc.Accumulator[!turn];
-	int32_t output = 0;
+	const std::array<int16_t, MaxHiddenSize>& hiddenFriendly = acc.Values(turn);
+	const std::array<int16_t, MaxHiddenSize>& hiddenOpponent = acc.Values(!turn);
 
 	const int pieceCount = Popcount(position.GetOccupancy());
 	const int outputBucket = GetOutputBucket(pieceCount);
 
-#ifdef __AVX2__
 	// Calculate output with handwritten SIMD (autovec also works, but it's slower)
-	// Idea by somelizard, it makes fast QA=255 SCReLU possible
-
-	auto HorizontalSum = [] (const __m256i sum) {
-		const auto upper_128 = _mm256_extracti128_si256(sum, 1);
-		const auto lower_128 = _mm256_castsi256_si128(sum);
-		const auto sum_128 = _mm_add_epi32(upper_128, lower_128);
-		const auto upper_64 = _mm_unpackhi_epi64(sum_128, sum_128);
-		const auto sum_64 = _mm_add_epi32(upper_64, sum_128);
-		const auto upper_32 = _mm_shuffle_epi32(sum_64, 0b00'00'00'01);
-		const auto sum_32 = _mm_add_epi32(upper_32, sum_64);
-		return _mm_cvtsi128_si32(sum_32);
-	};
-	
-	constexpr int chunkSize = 16; // for AVX2: 256/16=16
-	const auto min = _mm256_setzero_si256();
-	const auto max = _mm256_set1_epi16(static_cast<int16_t>(QA));
-	
-	auto sum = _mm256_setzero_si256();
-	for (int i = 0; i < (HiddenSize / chunkSize); i++) {
-		auto v = _mm256_load_si256((__m256i*) &hiddenFriendly[chunkSize * i]);
-		v = _mm256_min_epi16(_mm256_max_epi16(v, min), max);
-		const auto w = _mm256_load_si256((__m256i*) &Network->OutputWeights[outputBucket][chunkSize * i]);
-		const auto p = _mm256_madd_epi16(v, _mm256_mullo_epi16(v, w));
-		sum = _mm256_add_epi32(sum, p);
-	}
-	for (int i = 0; i < (HiddenSize / chunkSize); i++) {
-		auto v = _mm256_load_si256((__m256i*) &hiddenOpponent[chunkSize * i]);
-		v = _mm256_min_epi16(_mm256_max_epi16(v, min), max);
-		const auto w = _mm256_load_si256((__m256i*) &Network->OutputWeights[outputBucket][chunkSize * i + HiddenSize]);
-		const auto p = _mm256_madd_epi16(v, _mm256_mullo_epi16(v, w));
-		sum = _mm256_add_epi32(sum, p);
-	}
-	output = HorizontalSum(sum);
-#else
-	// Slower fallback
-	// if you end up here... that's bad.
-	auto Activation = [] (const int16_t value) {
-		const int32_t x = std::clamp<int32_t>(value, 0, QA);
-		return x * x;
-	};
-	for (int i = 0; i < HiddenSize; i++) output += Activation(hiddenFriendly[i]) * Network->OutputWeights[outputBucket][i];
-	for (int i = 0; i < HiddenSize; i++) output += Activation(hiddenOpponent[i]) * Network->OutputWeights[outputBucket][i + HiddenSize];
-#endif
+	int32_t output = Kernels.SCReLUOutput(hiddenFriendly.data(), hiddenOpponent.data(), net.OutputWeights(outputBucket));
 
-	constexpr int Q = QA * QB;
-	output = (output / QA + Network->OutputBias[outputBucket]) * Scale / Q; // for SCReLU
+	const int Q = net.QA * net.QB;
+	output = (output / net.QA + net.OutputBias(outputBucket)) * net.Scale / Q; // for SCReLU
+	return output;
+}
 
+int16_t ScaleNetworkOutput([[maybe_unused]] const Position& position, int32_t output) {
 #ifndef RENEGADE_DATAGEN
 	// Scale according to material
 	const int gamePhase = position.GetGamePhase();
@@ -123,8 +443,12 @@ int16_t NeuralEvaluate(const Position& position, const AccumulatorRepresentation
 	return std::clamp(output, -MateThreshold + 1, MateThreshold - 1);
 }
 
+int16_t NeuralEvaluate(const Position& position, const AccumulatorRepresentation& acc) {
+	return ScaleNetworkOutput(position, NetworkOutput(position, acc));
+}
+
 int16_t NeuralEvaluate(const Position& position) {
-	AccumulatorRepresentation acc{};
+	AccumulatorRepresentation acc;  // no need to zero it, refreshing overwrites the part in use
 	acc.RefreshBoth(position);
 	return NeuralEvaluate(position, acc);
 }
@@ -133,10 +457,16 @@ int16_t NeuralEvaluate(const Position& position) {
 
 int16_t EvaluationState::Evaluate(const Position& pos) {
 
+	// Positions seen recently don't need their accumulators to be brought up to date
+	const std::optional<int32_t> cachedOutput = OutputCache.Probe(pos.Hash());
+	if (cachedOutput.has_value()) return ScaleNetworkOutput(pos, cachedOutput.value());
+
 	// For evaluating, we need to make sure the accumulator is up-to-date for both sides
-	// The accumulators can be updated in two ways, in order of preference:
-	// - if applicable, incrementally from the last updated one
+	// The accumulators can be updated in the following ways:
+	// - if applicable, incrementally from the last updated one (one or more plies at once)
 	// - reconstructing it using a cache that we keep (colloquially known as "Finny tables")
+	// - refreshing from scratch, if the cache entry is further away than the position itself
+	// When catching up over multiple plies, the number of weight rows touched decides between the first two
 	
 	// Currently not used, but note that the accumulator stack and the position stack are indexed differently:
 	// const int basePositionIndex = pos.States.size() - CurrentIndex - 1;
@@ -155,13 +485,26 @@ int16_t EvaluationState::Evaluate(const Position& pos) {
 				return std::optional<int>(std::nullopt);
 			}();
 
-			if (latestUpdated.has_value()) {
-				for (int i = latestUpdated.value() + 1; i <= CurrentIndex; i++) {
-					UpdateIncrementally(side, i);
-				}
+			if (!latestUpdated.has_value()) {
+				UpdateFromBucketCache(pos, CurrentIndex, side);
+			}
+			else if (latestUpdated.value() == CurrentIndex - 1) {
+				UpdateIncrementally(side, CurrentIndex);
+				UpdateCounters.Incremental += 1;
 			}
 			else {
-				UpdateFromBucketCache(pos, CurrentIndex, side);
+				FeatureList subs{}, adds{};
+				CollectPendingDeltas(side, latestUpdated.value(), CurrentIndex, subs, adds);
+				const int incrementalCost = static_cast<int>(subs.size() + adds.size());
+				const int bucketCacheCost = GetBucketCacheCost(pos, side);
+
+				if (bucketCacheCost < incrementalCost) {
+					UpdateFromBucketCache(pos, CurrentIndex, side);
+				}
+				else {
+					ApplyPendingDeltas(side, latestUpdated.value(), CurrentIndex, subs, adds);
+					UpdateCounters.CatchUp += 1;
+				}
 			}
 		}
 	}
@@ -173,108 +516,255 @@ int16_t EvaluationState::Evaluate(const Position& pos) {
 	*/
 
 	// Now the accumulators are guaranteed to be correct, so the evaluation can be obtained
-	return NeuralEvaluate(pos, AccumulatorStack[CurrentIndex]);
+	const int32_t output = NetworkOutput(pos, AccumulatorStack[CurrentIndex], *Net);
+	OutputCache.Store(pos.Hash(), output);
+	return ScaleNetworkOutput(pos, output);
 }
 
-void EvaluationState::UpdateIncrementally(const bool side, const int accIndex) {
+// Evaluates a position which has no relation to the previous one, using only the bucket cache
+// Consecutive positions sharing king buckets make this cheap, as the cache entries only need small updates
+int16_t EvaluationState::EvaluateUnrelated(const Position& pos) {
+	CurrentIndex = 0;
+	AccumulatorRepresentation& acc = AccumulatorStack[0];
+	acc.Correct = { false, false };
+	acc.Alias = { nullptr, nullptr };
+	acc.KingSquare[Side::White] = pos.WhiteKingSquare();
+	acc.KingSquare[Side::Black] = pos.BlackKingSquare();
+	acc.ActiveBucket[Side::White] = GetInputBucket(acc.KingSquare[Side::White], Side::White);
+	acc.ActiveBucket[Side::Black] = GetInputBucket(acc.KingSquare[Side::Black], Side::Black);
+
+	UpdateFromBucketCache(pos, 0, Side::White);
+	UpdateFromBucketCache(pos, 0, Side::Black);
+	return NeuralEvaluate(pos, acc);
+}
 
-	const AccumulatorRepresentation& o = AccumulatorStack[accIndex - 1];  // o -> old
-	AccumulatorRepresentation& c = AccumulatorStack[accIndex];            // c -> current
-	const Move& m = c.move;
+// Collects the features removed and added by a move, the accumulator is only used for the king's square
+// This assumes no refresh is needed for the side, so the mirroring and the bucket are unchanged
+template<std::size_t capacity>
+static void CollectMoveDeltas(const AccumulatorRepresentation& c, const Move& m, const uint8_t movedPiece, const uint8_t capturedPiece,
+	const bool side, StaticVector<int, capacity>& subs, StaticVector<int, capacity>& adds) {
 
-	// Ensure the base accumulator is already up to date, and copy over the previous state
-	// (possible future optimization by deferring this and adding the accumulator change?)
-	assert(o.Correct[side]);
-	c.Accumulator[side] = o.Accumulator[side];
+	const auto sub = [&](const uint8_t piece, const uint8_t sq) { subs.push(c.FeatureIndex(side, piece, sq)); };
+	const auto add = [&](const uint8_t piece, const uint8_t sq) { adds.push(c.FeatureIndex(side, piece, sq)); };
 
-	// After completing the following, it's guaranteed that the accumulator will be up to date for the given side
-	c.Correct[side] = true;
-	
 	// For null-moves nothing changes, we're done here
 	if (m.IsNull()) return;
 
 	// Handle various cases of incremental updating
 	// (a) regular non-capture move
-	if (c.capturedPiece == Piece::None && !m.IsPromotion() && m.flag != MoveFlag::EnPassantPerformed) {
-		c.SubAddFeature({ c.movedPiece, m.from }, { c.movedPiece, m.to }, side);
+	if (capturedPiece == Piece::None && !m.IsPromotion() && m.flag != MoveFlag::EnPassantPerformed) {
+		sub(movedPiece, m.from);
+		add(movedPiece, m.to);
 		return;
 	}
 
 	// (b) regular capture move
-	if (c.capturedPiece != Piece::None && !m.IsPromotion() && m.flag != MoveFlag::EnPassantPerformed && !m.IsCastling()) {
-		c.SubSubAddFeature({ c.movedPiece, m.from }, { c.capturedPiece, m.to }, { c.movedPiece, m.to }, side);
+	if (capturedPiece != Piece::None && !m.IsPromotion() && m.flag != MoveFlag::EnPassantPerformed && !m.IsCastling()) {
+		sub(movedPiece, m.from);
+		sub(capturedPiece, m.to);
+		add(movedPiece, m.to);
 		return;
 	}
 
 	// (c) castling
 	if (m.IsCastling()) {
-		const bool castlingSide = ColorOfPiece(c.movedPiece) == PieceColor::White;
+		const bool castlingSide = ColorOfPiece(movedPiece) == PieceColor::White;
 		const bool shortCastle = m.flag == MoveFlag::ShortCastle;
 		const uint8_t rookPiece = castlingSide == Side::White ? Piece::WhiteRook : Piece::BlackRook;
 		const uint8_t newKingFile = shortCastle ? 6 : 2;
 		const uint8_t newRookFile = shortCastle ? 5 : 3;
 		const uint8_t newKingSquare = newKingFile + (castlingSide == Side::Black) * 56;
 		const uint8_t newRookSquare = newRookFile + (castlingSide == Side::Black) * 56;
-		c.SubAddFeature({ c.movedPiece, m.from }, { c.movedPiece, newKingSquare }, side);
-		c.SubAddFeature({ rookPiece, m.to }, { rookPiece, newRookSquare }, side);
+		sub(movedPiece, m.from);
+		sub(rookPiece, m.to);
+		add(movedPiece, newKingSquare);
+		add(rookPiece, newRookSquare);
 		return;
 	}
 
 	// (d) promotion - with optional capture
 	if (m.IsPromotion()) {
-		const uint8_t promotionPiece = m.GetPromotionPieceType() + (ColorOfPiece(c.movedPiece) == PieceColor::Black ? Piece::BlackPieceOffset : 0);
-		if (c.capturedPiece == Piece::None) c.SubAddFeature({ c.movedPiece, m.from }, { promotionPiece, m.to }, side);
-		else c.SubSubAddFeature({ c.movedPiece, m.from }, { c.capturedPiece, m.to }, { promotionPiece, m.to }, side);
+		const uint8_t promotionPiece = m.GetPromotionPieceType() + (ColorOfPiece(movedPiece) == PieceColor::Black ? Piece::BlackPieceOffset : 0);
+		sub(movedPiece, m.from);
+		if (capturedPiece != Piece::None) sub(capturedPiece, m.to);
+		add(promotionPiece, m.to);
 		return;
 	}
 
 	// (e) en passant
-	if (c.move.flag == MoveFlag::EnPassantPerformed) {
-		const uint8_t victimPiece = c.movedPiece == Piece::WhitePawn ? Piece::BlackPawn : Piece::WhitePawn;
-		const uint8_t victimSquare = c.movedPiece == Piece::WhitePawn ? (m.to - 8) : (m.to + 8);
-		c.SubSubAddFeature({ c.movedPiece, m.from }, { victimPiece, victimSquare }, { c.movedPiece, m.to }, side);
+	if (m.flag == MoveFlag::EnPassantPerformed) {
+		const uint8_t victimPiece = movedPiece == Piece::WhitePawn ? Piece::BlackPawn : Piece::WhitePawn;
+		const uint8_t victimSquare = movedPiece == Piece::WhitePawn ? (m.to - 8) : (m.to + 8);
+		sub(movedPiece, m.from);
+		sub(victimPiece, victimSquare);
+		add(movedPiece, m.to);
 		return;
 	}
 }
 
+void EvaluationState::UpdateIncrementally(const bool side, const int accIndex) {
+
+	const AccumulatorRepresentation& o = AccumulatorStack[accIndex - 1];  // o -> old
+	AccumulatorRepresentation& c = AccumulatorStack[accIndex];            // c -> current
+
+	// Ensure the base accumulator is already up to date
+	// (the previous state is not copied over separately, the fused updates below read it directly)
+	assert(o.Correct[side]);
+
+	StaticVector<int, 2> subs{}, adds{};
+	CollectMoveDeltas(c, c.move, c.movedPiece, c.capturedPiece, side, subs, adds);
+
+	// After completing this, it's guaranteed that the accumulator will be up to date for the given side
+	c.Correct[side] = true;
+
+	// Nothing changes for null-moves, so the values of the parent can be shared instead of copying them
+	if (subs.size() == 0) {
+		c.Alias[side] = &o.Values(side);
+		return;
+	}
+
+	int16_t* out = c.Accumulator[side].data();
+	const int16_t* in = o.Values(side).data();
+	const int bucket = c.ActiveBucket[side];
+	const auto weights = [&](const int feature) { return Net->FeatureWeights(bucket, feature); };
+
+	if (adds.size() == 1 && subs.size() == 1) Kernels.SubAddCopy(out, in, weights(subs[0]), weights(adds[0]));
+	else if (adds.size() == 1) Kernels.SubSubAddCopy(out, in, weights(subs[0]), weights(subs[1]), weights(adds[0]));
+	else Kernels.SubSubAddAddCopy(out, in, weights(subs[0]), weights(subs[1]), weights(adds[0]), weights(adds[1]));
+}
+
+void EvaluationState::CollectPendingDeltas(const bool side, const int baseIndex, const int targetIndex, FeatureList& subs, FeatureList& adds) const {
+
+	// Instead of going ply by ply, collect the feature changes of all pending moves, so that they can
+	// be applied in a single pass from the last correct accumulator into the target one
+	// A piece moving twice only leaves its final square, as the intermediate add and sub cancel out
+	const auto cancelOrPush = [](FeatureList& cancelFrom, FeatureList& pushTo, const int feature) {
+		for (std::size_t i = 0; i < cancelFrom.size(); i++) {
+			if (cancelFrom[i] != feature) continue;
+			cancelFrom[i] = cancelFrom[cancelFrom.size() - 1];
+			cancelFrom.pop();
+			return;
+		}
+		pushTo.push(feature);
+	};
+
+	for (int i = baseIndex + 1; i <= targetIndex; i++) {
+		StaticVector<int, 2> plySubs{}, plyAdds{};
+		const AccumulatorRepresentation& c = AccumulatorStack[i];
+		CollectMoveDeltas(c, c.move, c.movedPiece, c.capturedPiece, side, plySubs, plyAdds);
+		for (const int feature : plySubs) cancelOrPush(adds, subs, feature);
+		for (const int feature : plyAdds) cancelOrPush(subs, adds, feature);
+	}
+}
+
+void EvaluationState::ApplyPendingDeltas(const bool side, const int baseIndex, const int targetIndex, FeatureList& subs, FeatureList& adds) {
+
+	// The accumulators in-between are left untouched, and get recomputed on demand if ever needed
+	const AccumulatorRepresentation& o = AccumulatorStack[baseIndex];
+	AccumulatorRepresentation& c = AccumulatorStack[targetIndex];
+	assert(o.Correct[side]);
+
+	// The pending moves might have no net effect (e.g. null moves only), then the values can be shared
+	c.Correct[side] = true;
+	if (subs.size() == 0 && adds.size() == 0) {
+		c.Alias[side] = &o.Values(side);
+		return;
+	}
+
+	const int bucket = c.ActiveBucket[side];
+	const auto weights = [&](const int feature) { return Net->FeatureWeights(bucket, feature); };
+	std::array<const FeatureWeight*, (MaxDepth + 1) * 2> subRows, addRows;
+	for (std::size_t i = 0; i < subs.size(); i++) subRows[i] = weights(subs[i]);
+	for (std::size_t i = 0; i < adds.size(); i++) addRows[i] = weights(adds[i]);
+
+	Kernels.MultiUpdateCopy(c.Accumulator[side].data(), o.Values(side).data(),
+		subRows.data(), static_cast<int>(subs.size()), addRows.data(), static_cast<int>(adds.size()));
+}
+
+// Requests the weight rows the accumulator update after a move will read, called before the move is made
+// The rows are then loaded while the child probes the transposition table and gets its history entries,
+// instead of the update kernel stalling on them
+// Only the start of each row is requested: rows of the large network span 50 cache lines, and issuing all
+// of them for every move was measured to be much slower, while the hardware prefetcher picks up the rest
+// Sides needing a refresh are skipped, as those are rebuilt from the bucket cache instead
+int EvaluationState::PrefetchMoveRows(const Move& move, const uint8_t movedPiece, const uint8_t capturedPiece) const {
+#if defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
+	const AccumulatorRepresentation& parent = AccumulatorStack[CurrentIndex];
+	constexpr int prefetchedBytes = 4 * 64;
+	const int rowBytes = std::min(Net->HiddenSize * static_cast<int>(sizeof(FeatureWeight)), prefetchedBytes);
+	int rows = 0;
+
+	for (const bool side : {Side::White, Side::Black}) {
+		if (IsRefreshRequired(movedPiece, move, side)) continue;
+
+		StaticVector<int, 2> subs{}, adds{};
+		CollectMoveDeltas(parent, move, movedPiece, capturedPiece, side, subs, adds);
+		const auto prefetch = [&](const int feature) {
+			const char* row = reinterpret_cast<const char*>(Net->FeatureWeights(parent.ActiveBucket[side], feature));
+			for (int offset = 0; offset < rowBytes; offset += 64) __builtin_prefetch(row + offset);
+			rows += 1;
+		};
+		for (const int feature : subs) prefetch(feature);
+		for (const int feature : adds) prefetch(feature);
+	}
+	return rows;
+#else
+	return 0;
+#endif
+}
+
+// Features of the position from the perspective of the given side, as stored in the bucket cache
+static std::array<uint64_t, 12> GetFeatureBits(const Position& pos, const bool side) {
+	const Board& b = pos.CurrentState();
+	if (side == Side::White) return {
+		b.WhitePawnBits, b.WhiteKnightBits, b.WhiteBishopBits, b.WhiteRookBits, b.WhiteQueenBits, b.WhiteKingBits,
+		b.BlackPawnBits, b.BlackKnightBits, b.BlackBishopBits, b.BlackRookBits, b.BlackQueenBits, b.BlackKingBits
+	};
+	else return {
+		b.BlackPawnBits, b.BlackKnightBits, b.BlackBishopBits, b.BlackRookBits, b.BlackQueenBits, b.BlackKingBits,
+		b.WhitePawnBits, b.WhiteKnightBits, b.WhiteBishopBits, b.WhiteRookBits, b.WhiteQueenBits, b.WhiteKingBits
+	};
+}
+
+static int CountFeatureDifferences(const std::array<uint64_t, 12>& a, const std::array<uint64_t, 12>& b) {
+	int differences = 0;
+	for (int i = 0; i < 12; i++) differences += Popcount(a[i] ^ b[i]);
+	return differences;
+}
+
+BucketCacheEntry& EvaluationState::GetBucketCacheEntry(const bool side) {
+	const uint8_t kingSq = AccumulatorStack[CurrentIndex].KingSquare[side];
+	const int inputBucket = AccumulatorStack[CurrentIndex].ActiveBucket[side];
+	const int mirroring = GetSquareFile(kingSq) >= 4;
+	return BucketCache[side][inputBucket + (mirroring * MaxInputBucketCount)];
+}
+
+// Number of weight rows a refresh would touch, either from the cache, or from scratch if that's fewer
+// Refreshing via the cache also needs to copy the entry to the stack, that is counted as an extra row
+int EvaluationState::GetBucketCacheCost(const Position& pos, const bool side) {
+	const int differences = CountFeatureDifferences(GetFeatureBits(pos, side), GetBucketCacheEntry(side).featureBits);
+	return std::min(differences, Popcount(pos.GetOccupancy())) + 1;
+}
+
 void EvaluationState::UpdateFromBucketCache(const Position& pos, const int accIndex, const bool side) {
 
 	// Get the cache entry to be updated
 	const uint8_t kingSq = AccumulatorStack[CurrentIndex].KingSquare[side];
 	const int inputBucket = AccumulatorStack[CurrentIndex].ActiveBucket[side];
 	const int mirroring = GetSquareFile(kingSq) >= 4;
-	const int bucketCacheIndex = inputBucket + (mirroring * InputBucketCount);
-	BucketCacheEntry& cache = BucketCache[side][bucketCacheIndex];
+	BucketCacheEntry& cache = GetBucketCacheEntry(side);
 
 	// Calculate the feature boolean array for the current position
-	std::array<uint64_t, 12> featureBits;
-	if (side == Side::White) {
-		featureBits[0] = pos.CurrentState().WhitePawnBits;
-		featureBits[1] = pos.CurrentState().WhiteKnightBits;
-		featureBits[2] = pos.CurrentState().WhiteBishopBits;
-		featureBits[3] = pos.CurrentState().WhiteRookBits;
-		featureBits[4] = pos.CurrentState().WhiteQueenBits;
-		featureBits[5] = pos.CurrentState().WhiteKingBits;
-		featureBits[6] = pos.CurrentState().BlackPawnBits;
-		featureBits[7] = pos.CurrentState().BlackKnightBits;
-		featureBits[8] = pos.CurrentState().BlackBishopBits;
-		featureBits[9] = pos.CurrentState().BlackRookBits;
-		featureBits[10] = pos.CurrentState().BlackQueenBits;
-		featureBits[11] = pos.CurrentState().BlackKingBits;
+	const std::array<uint64_t, 12> featureBits = GetFeatureBits(pos, side);
+
+	// If the cached entry is further away than an empty board, it's cheaper to start from scratch
+	if (CountFeatureDifferences(featureBits, cache.featureBits) > Popcount(pos.GetOccupancy())) {
+		Kernels.Copy(cache.cachedAcc.data(), Net->FeatureBias());
+		cache.featureBits = {};
+		UpdateCounters.FullRefresh += 1;
 	}
 	else {
-		featureBits[0] = pos.CurrentState().BlackPawnBits;
-		featureBits[1] = pos.CurrentState().BlackKnightBits;
-		featureBits[2] = pos.CurrentState().BlackBishopBits;
-		featureBits[3] = pos.CurrentState().BlackRookBits;
-		featureBits[4] = pos.CurrentState().BlackQueenBits;
-		featureBits[5] = pos.CurrentState().BlackKingBits;
-		featureBits[6] = pos.CurrentState().WhitePawnBits;
-		featureBits[7] = pos.CurrentState().WhiteKnightBits;
-		featureBits[8] = pos.CurrentState().WhiteBishopBits;
-		featureBits[9] = pos.CurrentState().WhiteRookBits;
-		featureBits[10] = pos.CurrentState().WhiteQueenBits;
-		featureBits[11] = pos.CurrentState().WhiteKingBits;
+		UpdateCounters.BucketCache += 1;
 	}
 
 	// Compare it with the cached entry
@@ -300,19 +790,17 @@ void EvaluationState::UpdateFromBucketCache(const Position& pos, const int accIn
 	}
 
 	// Update the cache with the known differences
+	const auto weights = [&](const int feature) { return Net->FeatureWeights(inputBucket, feature); };
 	while (featuresToAdd.size() >= 4) {
 		const int f1 = featuresToAdd.pop_and_return();
 		const int f2 = featuresToAdd.pop_and_return();
 		const int f3 = featuresToAdd.pop_and_return();
 		const int f4 = featuresToAdd.pop_and_return();
-		for (int i = 0; i < HiddenSize; i++) {
-			cache.cachedAcc[i] += Network->FeatureWeights[inputBucket][f1][i] + Network->FeatureWeights[inputBucket][f2][i]
-				+ Network->FeatureWeights[inputBucket][f3][i] + Network->FeatureWeights[inputBucket][f4][i];
-		}
+		Kernels.AddAddAddAdd(cache.cachedAcc.data(), weights(f1), weights(f2), weights(f3), weights(f4));
 	}
 	while (featuresToAdd.size() >= 1) {
 		const int f = featuresToAdd.pop_and_return();
-		for (int i = 0; i < HiddenSize; i++) cache.cachedAcc[i] += Network->FeatureWeights[inputBucket][f][i];
+		Kernels.Add(cache.cachedAcc.data(), weights(f));
 	}
 
 	while (featuresToSub.size() >= 4) {
@@ -320,18 +808,108 @@ void EvaluationState::UpdateFromBucketCache(const Position& pos, const int accIn
 		const int f2 = featuresToSub.pop_and_return();
 		const int f3 = featuresToSub.pop_and_return();
 		const int f4 = featuresToSub.pop_and_return();
-		for (int i = 0; i < HiddenSize; i++) {
-			cache.cachedAcc[i] -= Network->FeatureWeights[inputBucket][f1][i] + Network->FeatureWeights[inputBucket][f2][i]
-				+ Network->FeatureWeights[inputBucket][f3][i] + Network->FeatureWeights[inputBucket][f4][i];
-		}
+		Kernels.SubSubSubSub(cache.cachedAcc.data(), weights(f1), weights(f2), weights(f3), weights(f4));
 	}
 	while (featuresToSub.size() >= 1) {
 		const int f = featuresToSub.pop_and_return();
-		for (int i = 0; i < HiddenSize; i++) cache.cachedAcc[i] -= Network->FeatureWeights[inputBucket][f][i];
+		Kernels.Sub(cache.cachedAcc.data(), weights(f));
 	}
 
-	// The cached entry is now updated, now copy it to the stack
+	// The cached entry is now updated, now copy it to the stack (only the part used by the network)
 	cache.featureBits = featureBits;
-	AccumulatorStack[accIndex].Accumulator[side] = cache.cachedAcc;
+	Kernels.Copy(AccumulatorStack[accIndex].Accumulator[side].data(), cache.cachedAcc.data());
 	AccumulatorStack[accIndex].Correct[side] = true;
 }
+
+// Batch evaluation -------------------------------------------------------------------------------
+// Positions are parsed, then ordered by the king buckets of both sides, so each thread goes through
+// runs of positions hitting the same bucket cache entries, instead of refreshing every position from scratch
+
+BatchEvaluator::BatchEvaluator(const int threadCount) {
+	const std::size_t threads = std::max(threadCount, 1);
+	for (std::size_t i = 0; i < threads; i++) States.push_back(std::make_unique<EvaluationState>());
+	for (std::size_t i = 0; i < threads; i++) Workers.emplace_back([this, i] { WorkerLoop(i); });
+}
+
+BatchEvaluator::~BatchEvaluator() {
+	std::unique_lock<std::mutex> lock(Mutex);
+	Exiting = true;
+	lock.unlock();
+	CondVar.notify_all();
+	for (std::thread& worker : Workers) worker.join();
+}
+
+void BatchEvaluator::WorkerLoop(const std::size_t worker) {
+	uint64_t seenGeneration = 0;
+	while (true) {
+		std::unique_lock<std::mutex> lock(Mutex);
+		CondVar.wait(lock, [&] { return Exiting || Generation != seenGeneration; });
+		if (Exiting) return;
+		seenGeneration = Generation;
+		const Work& work = *CurrentWork;
+		const std::size_t count = WorkCount;
+		lock.unlock();
+
+		const std::size_t threads = Workers.size();
+		work(worker, count * worker / threads, count * (worker + 1) / threads);
+
+		lock.lock();
+		Remaining -= 1;
+		if (Remaining == 0) {
+			lock.unlock();
+			CondVar.notify_all();
+		}
+	}
+}
+
+// Splits the range into contiguous slices, one for each worker, and waits until all of them are done
+void BatchEvaluator::RunOnWorkers(const std::size_t count, const Work& work) {
+	std::unique_lock<std::mutex> lock(Mutex);
+	CurrentWork = &work;
+	WorkCount = count;
+	Remaining = Workers.size();
+	Generation += 1;
+	lock.unlock();
+	CondVar.notify_all();
+
+	lock.lock();
+	CondVar.wait(lock, [&] { return Remaining == 0; });
+	CurrentWork = nullptr;
+}
+
+std::vector<int16_t> BatchEvaluator::Evaluate(const std::vector<std::string>& fens) {
+	const std::size_t count = fens.size();
+
+	// Parsing (only the board is kept, the rest of the position object is large)
+	std::vector<Board> boards(count);
+	std::vector<uint16_t> bucketKeys(count);
+	RunOnWorkers(count, [&](const std::size_t, const std::size_t begin, const std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			const Position pos = Position(fens[i]);
+			boards[i] = pos.CurrentState();
+
+			const auto bucketIndex = [&](const bool side) {
+				const uint8_t kingSq = (side == Side::White) ? pos.WhiteKingSquare() : pos.BlackKingSquare();
+				return GetInputBucket(kingSq, side) + (GetSquareFile(kingSq) >= 4) * MaxInputBucketCount;
+			};
+			bucketKeys[i] = bucketIndex(Side::White) * MaxInputBucketCount * 2 + bucketIndex(Side::Black);
+		}
+	});
+
+	// Ordering by the bucket cache entries used
+	std::vector<uint32_t> order(count);
+	for (std::size_t i = 0; i < count; i++) order[i] = static_cast<uint32_t>(i);
+	std::stable_sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b) { return bucketKeys[a] < bucketKeys[b]; });
+
+	// Evaluating, each thread gets a contiguous slice of the ordered positions
+	std::vector<int16_t> results(count);
+	RunOnWorkers(count, [&](const std::size_t worker, const std::size_t begin, const std::size_t end) {
+		EvaluationState& state = *States[worker];
+		Position pos = Position();
+		for (std::size_t i = begin; i < end; i++) {
+			pos.States.back() = boards[order[i]];
+			results[order[i]] = state.EvaluateUnrelated(pos);
+		}
+	});
+	return results;
+}
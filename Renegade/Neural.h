@@ -1,15 +1,24 @@
 #pragma once
+#include "Architecture.h"
+#include "Kernels.h"
+#include "Numa.h"
 #include "Position.h"
 #include <algorithm>
 #include <array>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
-
-#ifdef __AVX2__
-#include <immintrin.h>
-#endif
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 // This is the code for the NNUE evaluation
 // Renegade uses a horizontally mirrored perspective net with input buckets based on the king's
@@ -20,36 +29,95 @@
 // for each piece: score += (15 - (manhattan distance to opponent's king)) * 6
 
 // Network constants
+// (the int8 build embeds a converted copy of the same network, see Python/ConvertNetwork.py)
+#if defined(RENEGADE_INT8_WEIGHTS)
+#define NETWORK_NAME "renegade-net-36-int8.bin"
+#else
 #define NETWORK_NAME "renegade-net-36.bin"
+#endif
+
 
-constexpr int FeatureSize = 768;
-constexpr int HiddenSize = 1600;
-constexpr int Scale = 400;
-constexpr int QA = 255;
-constexpr int QB = 64;
-
-constexpr int InputBucketCount = 14;
-constexpr std::array<int, 32> InputBucketMap = {
-	 0,  1,  2,  3,
-	 4,  5,  6,  7,
-	 8,  8,  9,  9,
-	10, 10, 11, 11,
-	10, 10, 11, 11,
-	12, 12, 13, 13,
-	12, 12, 13, 13,
-	12, 12, 13, 13,
+template <typename Architecture>
+struct alignas(64) NetworkRepresentation {
+	alignas(64) MultiArray<FeatureWeight, Architecture::InputBucketCount, FeatureSize, Architecture::HiddenSize> FeatureWeights;
+	alignas(64) MultiArray<int16_t, Architecture::HiddenSize> FeatureBias;
+	alignas(64) MultiArray<int16_t, Architecture::OutputBucketCount, Architecture::HiddenSize * 2> OutputWeights;
+	MultiArray<int16_t, Architecture::OutputBucketCount> OutputBias;
 };
-constexpr int OutputBucketCount = 8;
 
+// The network in use, its shape is only known at runtime, as it depends on the loaded network file
+// The kernels are instantiated for each architecture, this just locates the parts of the network
+struct NetworkView {
+	const char* Data;
+	std::size_t Size;  // of the network representation
+	std::size_t ArchitectureIndex;
+	std::string_view ArchitectureName;
+	int HiddenSize, InputBucketCount, OutputBucketCount, OutputBucketDivisor;
+	int QA, QB, Scale;
+	std::array<int, 32> InputBucketMap;
+	const FeatureWeight* FeatureWeightData;
+	const int16_t* FeatureBiasData;
+	const int16_t* OutputWeightData;
+	const int16_t* OutputBiasData;
+
+	inline const FeatureWeight* FeatureWeights(const int bucket, const int feature) const {
+		return FeatureWeightData + (static_cast<std::size_t>(bucket) * FeatureSize + feature) * HiddenSize;
+	}
+	inline const int16_t* FeatureBias() const {
+		return FeatureBiasData;
+	}
+	inline const int16_t* OutputWeights(const int bucket) const {
+		return OutputWeightData + static_cast<std::size_t>(bucket) * HiddenSize * 2;
+	}
+	inline int16_t OutputBias(const int bucket) const {
+		return OutputBiasData[bucket];
+	}
+};
 
-struct alignas(64) NetworkRepresentation {
-	alignas(64) MultiArray<int16_t, InputBucketCount, FeatureSize, HiddenSize> FeatureWeights;
-	alignas(64) MultiArray<int16_t, HiddenSize> FeatureBias;
-	alignas(64) MultiArray<int16_t, OutputBucketCount, HiddenSize * 2> OutputWeights;
-	MultiArray<int16_t, OutputBucketCount> OutputBias;
+template <typename Architecture>
+NetworkView MakeNetworkView(const char* data, const std::size_t architectureIndex) {
+	const NetworkRepresentation<Architecture>* network = reinterpret_cast<const NetworkRepresentation<Architecture>*>(data);
+	return NetworkView{
+		data, sizeof(NetworkRepresentation<Architecture>), architectureIndex, Architecture::Name,
+		Architecture::HiddenSize, Architecture::InputBucketCount, Architecture::OutputBucketCount,
+		(32 + Architecture::OutputBucketCount - 1) / Architecture::OutputBucketCount,
+		Architecture::QA, Architecture::QB, Architecture::Scale, Architecture::InputBucketMap,
+		network->FeatureWeights[0][0].data(), network->FeatureBias.data(), network->OutputWeights[0].data(), network->OutputBias.data()
+	};
+}
+
+NetworkView MakeNetworkView(const char* data, const std::size_t architectureIndex);
+
+extern NetworkView Network;
+
+// Network files may start with a 64-byte header describing their contents, followed by the network
+// itself, files without a header are raw int16 networks of the default architecture as exported by the trainer
+// Raw networks can't be checksummed, so these are only accepted for the embedded network, EvalFile needs a header
+// (whenever the header or the layout of the network changes, the version should be bumped)
+
+constexpr std::array<char, 8> NetworkMagic = { 'R', 'E', 'N', 'E', 'G', 'A', 'D', 'E' };
+constexpr uint32_t NetworkFormatVersion = 1;
+
+struct NetworkHeader {
+	std::array<char, 8> Magic;
+	uint32_t Version;
+	uint32_t FeatureWeightBits;
+	uint32_t FeatureWeightShift;
+	uint32_t FeatureSize, HiddenSize, InputBucketCount, OutputBucketCount;
+	int32_t QA, QB, Scale;
+	uint64_t PayloadSize;  // equals sizeof(NetworkRepresentation) of the architecture
+	uint64_t Checksum;     // of the payload, see NetworkChecksum()
 };
+static_assert(sizeof(NetworkHeader) == 64);
 
-extern const NetworkRepresentation* Network;
+// Where the network starts within the file, and which of the supported architectures it is
+struct NetworkFileInfo {
+	std::size_t Offset;
+	std::size_t ArchitectureIndex;
+};
+
+uint64_t NetworkChecksum(const char* data, const std::size_t size);
+std::optional<NetworkFileInfo> ValidateNetwork(const char* data, const std::size_t size, const std::string_view name, const bool allowRaw);
 
 
 struct PieceAndSquare {
@@ -59,18 +127,25 @@ struct PieceAndSquare {
 struct AccumulatorRepresentation;
 int16_t NeuralEvaluate(const Position& position);
 int16_t NeuralEvaluate(const Position& position, const AccumulatorRepresentation& acc);
+int32_t NetworkOutput(const Position& position, const AccumulatorRepresentation& acc, const NetworkView& net = Network);
+int16_t ScaleNetworkOutput(const Position& position, int32_t output);
 void LoadDefaultNetwork();
+bool LoadNetworkFromFile(const std::string& path);
+void RestoreDefaultNetwork();
+void SetNetworkMemoryOptions(const bool hugePages, const bool lock);
+std::string DescribeNetworkMemory();
+void SetNetworkReplication(const bool enabled);
+const NetworkView& NetworkForNode(const int node);
 
 inline int GetInputBucket(const uint8_t kingSq, const bool side) {
 	const uint8_t transform = side == Side::White ? 0 : 56;
 	const uint8_t rank = GetSquareRank(kingSq ^ transform);
 	const uint8_t file = GetSquareFile(kingSq ^ transform) < 4 ? GetSquareFile(kingSq ^ transform) : (GetSquareFile(kingSq ^ transform) ^ 7);
-	return InputBucketMap[rank * 4 + file];
+	return Network.InputBucketMap[rank * 4 + file];
 }
 
 inline int GetOutputBucket(const int pieceCount) {
-	constexpr int divisor = (32 + OutputBucketCount - 1) / OutputBucketCount;
-	return (pieceCount - 2) / divisor;
+	return (pieceCount - 2) / Network.OutputBucketDivisor;
 }
 
 inline bool IsRefreshRequired(const uint8_t piece, const Move& move, const bool side) {
@@ -96,7 +171,8 @@ inline bool IsRefreshRequired(const uint8_t piece, const Move& move, const bool
 
 struct alignas(64) AccumulatorRepresentation {
 
-	std::array<std::array<int16_t, HiddenSize>, 2> Accumulator;
+	std::array<std::array<int16_t, MaxHiddenSize>, 2> Accumulator;
+	std::array<const std::array<int16_t, MaxHiddenSize>*, 2> Alias{};  // set if the values are shared with a parent
 	std::array<uint8_t, 2> ActiveBucket;
 	std::array<uint8_t, 2> KingSquare;
 	std::array<bool, 2> Correct;
@@ -105,13 +181,20 @@ struct alignas(64) AccumulatorRepresentation {
 	uint8_t movedPiece, capturedPiece;
 
 
+	// Values of the accumulator for a side, after no-op plies (such as null moves) these are not copied,
+	// the entry just points to the data of the accumulator it was derived from
+	inline const std::array<int16_t, MaxHiddenSize>& Values(const bool side) const {
+		return Alias[side] ? *Alias[side] : Accumulator[side];
+	}
+
 	void RefreshBoth(const Position& pos) {
 		RefreshSide(Side::White, pos.CurrentState());
 		RefreshSide(Side::Black, pos.CurrentState());
 	}
 
 	void RefreshSide(const bool side, const Board& b) {
-		for (int i = 0; i < HiddenSize; i++) Accumulator[side][i] = Network->FeatureBias[i];
+		Kernels.Copy(Accumulator[side].data(), Network.FeatureBias());
+		Alias[side] = nullptr;
 		KingSquare[side] = LsbSquare(side == Side::White ? b.WhiteKingBits : b.BlackKingBits);
 		ActiveBucket[side] = GetInputBucket(KingSquare[side], side);
 		
@@ -127,32 +210,7 @@ struct alignas(64) AccumulatorRepresentation {
 	void AddFeatureForSide(const bool side, const uint8_t piece, const uint8_t sq) {
 		const int feature = FeatureIndex(side, piece, sq);
 		const int bucket = ActiveBucket[side];
-		for (int i = 0; i < HiddenSize; i++) Accumulator[side][i] += Network->FeatureWeights[bucket][feature][i];
-	}
-
-	// Fused NNUE updates are generally a speedup, however it seems to depend on the exact machine:
-	// failed to gain when tested on cloud workers, even though there was around a ~5% nps increase
-	// locally. For this reason this code stays for now, but it requires further investigation. Is
-	// it possible, that this optimization no longer gains due to better compilers getting better?
-
-	void SubAddFeature(const PieceAndSquare& f1, const PieceAndSquare& f2, const bool side) {
-		const auto features1 = FeatureIndex(side, f1.piece, f1.square);
-		const auto features2 = FeatureIndex(side, f2.piece, f2.square);
-		const int bucket = ActiveBucket[side];
-		for (int i = 0; i < HiddenSize; i++) Accumulator[side][i] +=
-			- Network->FeatureWeights[bucket][features1][i]
-			+ Network->FeatureWeights[bucket][features2][i];
-	}
-
-	void SubSubAddFeature(const PieceAndSquare& f1, const PieceAndSquare& f2, const PieceAndSquare& f3, const bool side) {
-		const int bucket = ActiveBucket[side];
-		const auto features1 = FeatureIndex(side, f1.piece, f1.square);
-		const auto features2 = FeatureIndex(side, f2.piece, f2.square);
-		const auto features3 = FeatureIndex(side, f3.piece, f3.square);
-		for (int i = 0; i < HiddenSize; i++) Accumulator[side][i] +=
-			- Network->FeatureWeights[bucket][features1][i]
-			- Network->FeatureWeights[bucket][features2][i]
-			+ Network->FeatureWeights[bucket][features3][i];
+		Kernels.Add(Accumulator[side].data(), Network.FeatureWeights(bucket, feature));
 	}
 
 	inline int FeatureIndex(const bool perspective, const uint8_t piece, const uint8_t sq) const {
@@ -169,18 +227,79 @@ struct alignas(64) AccumulatorRepresentation {
 };
 
 struct alignas(64) BucketCacheEntry {
-	alignas(64) std::array<int16_t, HiddenSize> cachedAcc;
+	alignas(64) std::array<int16_t, MaxHiddenSize> cachedAcc;
 	std::array<uint64_t, 12> featureBits{};
 
 	BucketCacheEntry() {
-		for (int i = 0; i < HiddenSize; i++) cachedAcc[i] = Network->FeatureBias[i];
+		Kernels.Copy(cachedAcc.data(), Network.FeatureBias());
+	}
+};
+
+// How many times each way of bringing an accumulator up to date was chosen (counted per side)
+struct AccumulatorUpdateCounters {
+	uint64_t Incremental = 0;  // from the previous ply
+	uint64_t CatchUp = 0;      // over multiple plies at once
+	uint64_t BucketCache = 0;  // from the Finny table entry
+	uint64_t FullRefresh = 0;  // from scratch, the cache entry was too far off
+
+	AccumulatorUpdateCounters& operator+=(const AccumulatorUpdateCounters& other) {
+		Incremental += other.Incremental;
+		CatchUp += other.CatchUp;
+		BucketCache += other.BucketCache;
+		FullRefresh += other.FullRefresh;
+		return *this;
+	}
+};
+
+// Small per-thread cache of network outputs keyed by the position's hash, so positions that are
+// evaluated again (transpositions, qsearch leaves, positions missing from the TT) skip the accumulator
+// updates and the output layer
+// The stored value is before the material and halfmove clock scaling, as the latter isn't in the hash
+struct EvalCacheEntry {
+	uint32_t key;
+	int32_t output;
+};
+
+struct EvalCache {
+	static constexpr int Size = 8192;  // 64 KB, small enough to stay in L2
+	static constexpr int32_t Empty = std::numeric_limits<int32_t>::min();
+
+	std::array<EvalCacheEntry, Size> Entries;
+	uint64_t Hits = 0;
+	uint64_t Misses = 0;
+
+	EvalCache() {
+		Clear();
+	}
+
+	inline void Clear() {
+		Entries.fill({ 0, Empty });
+	}
+
+	inline std::optional<int32_t> Probe(const uint64_t hash) {
+		const EvalCacheEntry& entry = Entries[hash % Size];
+		if (entry.output != Empty && entry.key == static_cast<uint32_t>(hash >> 32)) {
+			Hits += 1;
+			return entry.output;
+		}
+		Misses += 1;
+		return std::nullopt;
+	}
+
+	inline void Store(const uint64_t hash, const int32_t output) {
+		Entries[hash % Size] = { static_cast<uint32_t>(hash >> 32), output };
 	}
 };
 
 struct EvaluationState {
+	using FeatureList = StaticVector<int, (MaxDepth + 1) * 2>;
+
 	std::array<AccumulatorRepresentation, MaxDepth + 1> AccumulatorStack;
 	int CurrentIndex;
-	MultiArray<BucketCacheEntry, 2, InputBucketCount * 2> BucketCache;
+	MultiArray<BucketCacheEntry, 2, MaxInputBucketCount * 2> BucketCache;
+	AccumulatorUpdateCounters UpdateCounters;
+	EvalCache OutputCache;
+	const NetworkView* Net = &Network;  // the weights read by the updates, a replica on the thread's NUMA node if any
 
 	inline void PushState(const Position& pos, const Move move, const uint8_t movedPiece, const uint8_t capturedPiece) {
 		CurrentIndex += 1;
@@ -189,6 +308,7 @@ struct EvaluationState {
 		current.movedPiece = movedPiece;
 		current.capturedPiece = capturedPiece;
 		current.Correct = { false, false };
+		current.Alias = { nullptr, nullptr };
 		current.KingSquare[Side::White] = pos.WhiteKingSquare();
 		current.KingSquare[Side::Black] = pos.BlackKingSquare();
 		current.ActiveBucket[Side::White] = GetInputBucket(current.KingSquare[Side::White], Side::White);
@@ -205,7 +325,46 @@ struct EvaluationState {
 		AccumulatorStack[0].RefreshBoth(pos);
 	}
 
+	// The cached accumulators and outputs depend on the weights, so these must be reset when the network changes
+	inline void ResetBucketCache() {
+		for (auto& entries : BucketCache) {
+			for (BucketCacheEntry& entry : entries) entry = BucketCacheEntry();
+		}
+		OutputCache.Clear();
+	}
+
 	int16_t Evaluate(const Position& pos);
+	int16_t EvaluateUnrelated(const Position& pos);
 	void UpdateIncrementally(const bool side, const int accIndex);
+	void CollectPendingDeltas(const bool side, const int baseIndex, const int targetIndex, FeatureList& subs, FeatureList& adds) const;
+	void ApplyPendingDeltas(const bool side, const int baseIndex, const int targetIndex, FeatureList& subs, FeatureList& adds);
+	int PrefetchMoveRows(const Move& move, const uint8_t movedPiece, const uint8_t capturedPiece) const;
 	void UpdateFromBucketCache(const Position& pos, const int accIndex, const bool side);
+	BucketCacheEntry& GetBucketCacheEntry(const bool side);
+	int GetBucketCacheCost(const Position& pos, const bool side);
+};
+
+// Evaluates many unrelated positions at once (used for rescoring datasets)
+// The worker threads are started once and kept for every batch, along with their evaluation states
+// The FENs are expected to be valid, the results are in the same order as the input
+class BatchEvaluator {
+public:
+	BatchEvaluator(const int threadCount);
+	~BatchEvaluator();
+	std::vector<int16_t> Evaluate(const std::vector<std::string>& fens);
+
+private:
+	using Work = std::function<void(const std::size_t worker, const std::size_t begin, const std::size_t end)>;
+	void RunOnWorkers(const std::size_t count, const Work& work);
+	void WorkerLoop(const std::size_t worker);
+
+	std::vector<std::thread> Workers;
+	std::vector<std::unique_ptr<EvaluationState>> States;
+	std::mutex Mutex;
+	std::condition_variable CondVar;
+	const Work* CurrentWork = nullptr;
+	std::size_t WorkCount = 0;
+	uint64_t Generation = 0;  // increased for each piece of work, the workers wait for it to change
+	std::size_t Remaining = 0;
+	bool Exiting = false;
 };
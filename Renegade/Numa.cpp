@@ -0,0 +1,149 @@
+#include "Numa.h"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct NodeInfo {
+	int id;
+	std::vector<int> cpus;
+};
+
+// Parses the kernel's list format, such as "0-3,8-11"
+static std::vector<int> ParseList(const std::string& text) {
+	std::vector<int> values;
+	std::stringstream ss(text);
+	std::string range;
+	while (std::getline(ss, range, ',')) {
+		if (range.empty() || range[0] < '0' || range[0] > '9') continue;
+		const std::size_t dash = range.find('-');
+		const int first = std::stoi(range.substr(0, dash));
+		const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+		for (int i = first; i <= last; i++) values.push_back(i);
+	}
+	return values;
+}
+
+static std::string ReadLine(const std::string& path) {
+	std::ifstream ifs(path);
+	std::string line;
+	std::getline(ifs, line);
+	return line;
+}
+
+// Nodes without CPUs (memory-only nodes) are left out, as no thread could be placed there
+static std::vector<NodeInfo> DetectNodes() {
+	std::vector<NodeInfo> nodes;
+#ifdef __linux__
+	for (const int id : ParseList(ReadLine("/sys/devices/system/node/online"))) {
+		if (static_cast<int>(nodes.size()) == Numa::MaxNodes) break;
+		std::vector<int> cpus = ParseList(ReadLine("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist"));
+		if (!cpus.empty()) nodes.push_back({ id, cpus });
+	}
+#endif
+	if (nodes.empty()) nodes.push_back({ 0, {} });
+	return nodes;
+}
+
+static const std::vector<NodeInfo>& Nodes() {
+	static const std::vector<NodeInfo> nodes = DetectNodes();
+	return nodes;
+}
+
+#ifdef __linux__
+// From linux/mempolicy.h, defined here as the kernel headers may not be installed
+static constexpr int MPOL_BIND = 2;
+static constexpr int MPOL_INTERLEAVE = 3;
+static constexpr unsigned int MPOL_MF_MOVE = 1 << 1;
+
+static constexpr int MaskBits = 1024;  // node ids, not indices, go into the mask
+using NodeMask = std::array<unsigned long, MaskBits / (8 * sizeof(unsigned long))>;
+
+static void AddToMask(NodeMask& mask, const int nodeId) {
+	constexpr int bitsPerWord = 8 * sizeof(unsigned long);
+	if (nodeId < MaskBits) mask[nodeId / bitsPerWord] |= 1UL << (nodeId % bitsPerWord);
+}
+
+// mbind only accepts page aligned ranges, so only the pages fully inside the range get the policy
+// The policy applies to pages not yet touched, existing pages are moved if possible
+static bool SetMemoryPolicy(void* address, const std::size_t size, const int mode, const NodeMask& mask) {
+	const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	const std::size_t start = (reinterpret_cast<std::size_t>(address) + pageSize - 1) / pageSize * pageSize;
+	const std::size_t end = (reinterpret_cast<std::size_t>(address) + size) / pageSize * pageSize;
+	if (end <= start) return false;
+	// maxnode is one more than the mask's bit count, the kernel ignores the last bit
+	return syscall(SYS_mbind, start, end - start, mode, mask.data(), MaskBits + 1, MPOL_MF_MOVE) == 0;
+}
+#endif
+
+int Numa::NodeCount() {
+	return static_cast<int>(Nodes().size());
+}
+
+// Threads are spread round-robin, so that a search with fewer threads than cores still uses every node's
+// memory bandwidth and caches
+int Numa::NodeForThread(const int threadId) {
+	return threadId % NodeCount();
+}
+
+bool Numa::PinCurrentThread(const int node) {
+#ifdef __linux__
+	if (NodeCount() == 1) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (const int cpu : Nodes()[node].cpus) {
+		if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+	}
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	(void)node;
+	return false;
+#endif
+}
+
+// Spreads the pages across the nodes, for memory shared by all threads (the transposition table)
+bool Numa::InterleaveMemory(void* address, const std::size_t size) {
+#ifdef __linux__
+	if (NodeCount() == 1) return false;
+	NodeMask mask{};
+	for (const NodeInfo& node : Nodes()) AddToMask(mask, node.id);
+	return SetMemoryPolicy(address, size, MPOL_INTERLEAVE, mask);
+#else
+	(void)address;
+	(void)size;
+	return false;
+#endif
+}
+
+// Places the pages on the given node, for memory read by that node's threads (network replicas)
+bool Numa::BindMemory(void* address, const std::size_t size, const int node) {
+#ifdef __linux__
+	if (NodeCount() == 1) return false;
+	NodeMask mask{};
+	AddToMask(mask, Nodes()[node].id);
+	return SetMemoryPolicy(address, size, MPOL_BIND, mask);
+#else
+	(void)address;
+	(void)size;
+	(void)node;
+	return false;
+#endif
+}
+
+std::string Numa::DescribeTopology() {
+	std::string text = std::to_string(NodeCount()) + (NodeCount() == 1 ? " node" : " nodes");
+	if (Nodes()[0].cpus.empty()) return text + " (topology unknown)";
+	text += " (";
+	for (std::size_t i = 0; i < Nodes().size(); i++) {
+		if (i != 0) text += ", ";
+		text += "node " + std::to_string(Nodes()[i].id) + ": " + std::to_string(Nodes()[i].cpus.size()) + " cpus";
+	}
+	return text + ")";
+}
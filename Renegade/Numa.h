@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// NUMA support without depending on libnuma ------------------------------------------------------
+// The topology is read from sysfs, and threads and memory are placed with the underlying system calls
+// This is only done on Linux, elsewhere (or if the topology can't be read) there's a single node,
+// and the placement functions do nothing
+
+namespace Numa {
+	constexpr int MaxNodes = 64;
+
+	int NodeCount();
+	int NodeForThread(const int threadId);
+	bool PinCurrentThread(const int node);
+	bool InterleaveMemory(void* address, const std::size_t size);
+	bool BindMemory(void* address, const std::size_t size, const int node);
+	std::string DescribeTopology();
+}
@@ -12,9 +12,12 @@
 // - Movepicker     : decides the order in which moves should be explored
 // - Classical      : handcrafted board evaluation (older and weaker, normally isn't used)
 // - Neural         : NNUE board evaluation (default)
+// - Architecture   : shapes of the supported neural networks
+// - Kernels        : vectorized NNUE accumulator and output layer code, compiled per instruction set
+// - Simd           : wrappers for the vector instructions used by the NNUE kernels
 // - Datagen        : data generation tool for training NNUE networks
 // - Reporting      : output structure used by search & displaying search results
-// - Magics         : magic bitboard lookups for sliding pieces
+// - Magics         : magic bitboard and pext lookups for sliding pieces
 // - Settings       : handling engine-wide options and parameter tuning
 // - Utils          : other misc functions, lookup tables and shared variables
 
@@ -22,6 +25,7 @@
 
 int main(int argc, char* argv[]) {
 	GenerateMagicTables();
+	SelectKernels();
 	LoadDefaultNetwork();
 
 	Engine engine = Engine(argc, argv);
@@ -55,13 +55,15 @@ void PrintInfo(const Results& r) {
 		wdlOutput = " wdl " + std::to_string(w) + " " + std::to_string(d) + " " + std::to_string(l);
 	}
 
+	const std::string multiPVOutput = (r.multiPV != 0) ? " multipv " + std::to_string(r.multiPV) : "";
+
 #if defined(_MSC_VER)
-	const std::string output = std::format("info depth {} seldepth {} score {}{} nodes {} nps {} time {} hashfull {} pv{}",
-		r.depth, r.seldepth, score, wdlOutput, r.nodes, r.nps, r.time, r.hashfull, pvString);
+	const std::string output = std::format("info depth {} seldepth {}{} score {}{} nodes {} nps {} time {} hashfull {} pv{}",
+		r.depth, r.seldepth, multiPVOutput, score, wdlOutput, r.nodes, r.nps, r.time, r.hashfull, pvString);
 
 #else
 	const std::string output = "info depth " + std::to_string(r.depth) + " seldepth " + std::to_string(r.seldepth)
-		+ " score " + score + wdlOutput + " nodes " + std::to_string(r.nodes) + " nps " + std::to_string(r.nps)
+		+ multiPVOutput + " score " + score + wdlOutput + " nodes " + std::to_string(r.nodes) + " nps " + std::to_string(r.nps)
 		+ " time " + std::to_string(r.time) + " hashfull " + std::to_string(r.hashfull)
 		+ " pv" + pvString;
 #endif
@@ -153,6 +155,7 @@ void PrintPretty([[maybe_unused]] const Results& r) {
 #endif
 }
 
-void PrintBestmove(const Move& move) {
-	cout << "bestmove " << move.ToString(Settings::Chess960) << endl;
+void PrintBestmove(const Move& move, const Move& ponderMove) {
+	if (ponderMove.IsNull()) cout << "bestmove " << move.ToString(Settings::Chess960) << endl;
+	else cout << "bestmove " << move.ToString(Settings::Chess960) << " ponder " << ponderMove.ToString(Settings::Chess960) << endl;
 }
\ No newline at end of file
@@ -18,6 +18,7 @@ struct Results {
 	int ply = 0;
 	std::vector<Move> pv;
 	int threads = 1;
+	int multiPV = 0;  // index of the line (starting from 1) when searching multiple lines, otherwise 0
 
 	Results();
 	Results(const int score, const int depth, const int seldepth, const uint64_t nodes, const uint64_t time,
@@ -27,4 +28,4 @@ struct Results {
 
 void PrintInfo(const Results& r);
 void PrintPretty(const Results& r);
-void PrintBestmove(const Move& move);
+void PrintBestmove(const Move& move, const Move& ponderMove = NullMove);
@@ -1,4 +1,5 @@
 #include "Search.h"
+#include "Classical.h"
 
 // This is the main search code of Renegade. If you're reading this, you're probably interested in
 // what this engine does under the hood, and I'm happy for that, feel free to try some ideas from here!
@@ -12,12 +13,31 @@ Search::Search() {
 		}
 	}
 	StartThreads(1);
+	Timekeeper = std::thread([&] { TimekeeperLoop(); });
+}
+
+Search::~Search() {
+	std::unique_lock<std::mutex> lock(TimekeeperMutex);
+	TimekeeperExit = true;
+	lock.unlock();
+	TimekeeperCondVar.notify_one();
+	Timekeeper.join();
 }
 
 void ThreadData::ResetStatistics() {
 	RootDepth = 0;
 	SelDepth = 0;
 	Nodes = 0;
+	PublishedNodes = 0;
+}
+
+// Requests what the child node is going to read right after the move is made: the weight rows for the
+// accumulator update and the correction history slots, so these loads overlap with making the move
+// This is done after the pruning decisions, prefetching for moves that end up being skipped is wasted
+void ThreadData::PrefetchForMove(const Position& position, const Move& m, const uint8_t movedPiece, const uint8_t capturedPiece) {
+	if (!Settings::SoftwarePrefetch) return;
+	Prefetches.WeightRows += EvalState.PrefetchMoveRows(m, movedPiece, capturedPiece);
+	Prefetches.HistorySlots += History.PrefetchForChild(position, m, movedPiece, capturedPiece);
 }
 
 void Search::ResetState(const bool clearTT) {
@@ -25,34 +45,87 @@ void Search::ResetState(const bool clearTT) {
 	if (clearTT) TranspositionTable.Clear(Settings::Threads);
 }
 
+// The nodestime budget lasts for the whole game, it's only taken from the GUI's clock again in a new one
+void Search::ResetNodesTime() {
+	NodesTimeLeft = -1;
+}
+
+// Called after switching networks: anything derived from the old weights must be discarded
+void Search::ResetEvaluationState() {
+	for (ThreadData& t : Threads) t.EvalState.ResetBucketCache();
+	ResetState(true);
+}
+
+// Thread pool ------------------------------------------------------------------------------------
+// Threads sleep on their condition variables between searches, and wake up as soon as they are notified
+// Waiting for other threads is also done by blocking on condition variables instead of spinning
+// Resizing only adds or removes threads at the end, the rest of them (and their histories) are kept
+
+// Adds threads until there are the given number of them, and waits until the new ones are ready
+// Each thread constructs its own data: with first-touch allocation the pages end up on the node the thread
+// runs on, which with a NUMA policy set is the one it was pinned to (before touching anything)
 void Search::StartThreads(const int threadCount) {
-	assert(Threads.size() == 0);
-	LoadedThreadCount.store(0);
-	for (int i = 0; i < threadCount; i++) {
-		ThreadData& t = Threads.emplace_back();
-		t.threadId = i;
-		t.Thread = std::thread([&] { Loop(t); });
+	for (int i = static_cast<int>(Threads.size()); i < threadCount; i++) {
+		std::thread thread([this, i] {
+			const int node = Numa::NodeForThread(i);
+			if (Settings::NumaPlacement != NumaPolicy::None) Numa::PinCurrentThread(node);
+			std::unique_lock<std::mutex> lock(PoolMutex);
+			ThreadData& t = Threads.emplace_back();
+			t.threadId = i;
+			t.NumaNode = node;
+			lock.unlock();
+			Loop(t);
+		});
+		std::unique_lock<std::mutex> lock(PoolMutex);
+		PoolCondVar.wait(lock, [&] { return LoadedThreadCount.load() == i + 1; });
+		Threads.back().Thread = std::move(thread);
 	}
-	while (LoadedThreadCount.load() < static_cast<int>(Threads.size())) {};
 }
 
-void Search::StopThreads() {
-	StopSearch();
-	for (ThreadData& t : Threads) {
-		std::unique_lock<std::mutex> lock(t.Mutex);
-		t.Action = ThreadAction::Exit;
+// Stops the threads beyond the given number, the search must not be running
+void Search::RemoveThreads(const int threadCount) {
+	if (static_cast<int>(Threads.size()) <= threadCount) return;
+	const auto first = std::next(Threads.begin(), threadCount);
+	for (auto it = first; it != Threads.end(); ++it) {
+		std::unique_lock<std::mutex> lock(it->Mutex);
+		it->Action = ThreadAction::Exit;
 		lock.unlock();
-		t.CondVar.notify_one();
+		it->CondVar.notify_one();
 	}
-	for (ThreadData& t : Threads) t.Thread.join();
-	Threads.clear();
+	for (auto it = first; it != Threads.end(); ++it) it->Thread.join();
+	Threads.erase(first, Threads.end());
+}
+
+void Search::StopThreads() {
+	StopSearch();
+	RemoveThreads(0);
 }
 
 void Search::SetThreadCount(const int threadCount) {
+	StopSearch();
+	if (threadCount < static_cast<int>(Threads.size())) RemoveThreads(threadCount);
+	else StartThreads(threadCount);
+}
+
+// The threads are recreated to be placed (and to allocate their data) according to the new policy,
+// the hash is reallocated and cleared, and the network replicas are created or freed
+void Search::ApplyNumaPolicy() {
+	const int threadCount = static_cast<int>(Threads.size());
 	StopThreads();
+	const bool placed = Settings::NumaPlacement != NumaPolicy::None;
+	TranspositionTable.SetInterleaved(placed, Settings::Threads);
+	SetNetworkReplication(Settings::NumaPlacement == NumaPolicy::Replicate);
 	StartThreads(threadCount);
 }
 
+// Wakes up whoever waits on the pool, changes to the awaited conditions must be made before calling this
+// (taking the lock in between ensures a thread checking the condition doesn't miss the notification)
+void Search::NotifyPool() {
+	std::unique_lock<std::mutex> lock(PoolMutex);
+	lock.unlock();
+	PoolCondVar.notify_all();
+}
+
 Results Search::SearchSinglethreaded(const Position& pos, const SearchParams& params) {
 	StartSearchTime = Clock::now();
 	Aborting.store(false);
@@ -63,8 +136,13 @@ Results Search::SearchSinglethreaded(const Position& pos, const SearchParams& pa
 	t.result = {};
 	t.ResetStatistics();
 	Constraints = CalculateConstraints(params, pos.Turn());
+	Settings::HybridEvalScale = FromCentipawns(100, pos.GetPly());
+	RootMoveFilter.clear();
+	ResetNodeCounter(1);
+	if (Constraints.SearchTimeMax != -1) ArmDeadline(Constraints.SearchTimeMax);
 
 	SearchMoves(t);
+	DisarmDeadline();
 	t.singlethreaded = false;
 	return t.result;
 }
@@ -84,7 +162,27 @@ void Search::StartSearch(Position& position, const SearchParams params) {
 		return;
 	}
 
-	Constraints = CalculateConstraints(params, position.Turn());
+	// Restrict the root moves with searchmoves, if none of them is legal it's ignored
+	RootMoveFilter.clear();
+	for (const std::string& str : params.searchmoves) {
+		for (const ScoredMove& m : rootLegalMoves) {
+			if (m.move.ToString(Settings::Chess960) == str) RootMoveFilter.push_back(m.move);
+		}
+	}
+
+	// With nodestime the clock is replaced by a node budget, which is converted back to milliseconds at the
+	// given rate: the GUI's clock runs on wall time, so after the first move the engine keeps track of the
+	// budget itself, charging the nodes searched and crediting the increments
+	SearchParams adjustedParams = params;
+	if (Settings::NodesTime != 0 && (params.wtime != 0 || params.btime != 0)) {
+		const bool turn = position.Turn();
+		if (NodesTimeLeft == -1) NodesTimeLeft = static_cast<int64_t>(turn ? params.wtime : params.btime) * Settings::NodesTime;
+		NodesTimeIncrement = static_cast<int64_t>(turn ? params.winc : params.binc) * Settings::NodesTime;
+		const int budgetMs = static_cast<int>(std::clamp<int64_t>(NodesTimeLeft / Settings::NodesTime, 1, std::numeric_limits<int>::max()));
+		(turn ? adjustedParams.wtime : adjustedParams.btime) = budgetMs;
+	}
+	Constraints = CalculateConstraints(adjustedParams, position.Turn());
+	Settings::HybridEvalScale = FromCentipawns(100, position.GetPly());
 
 	// Reduce time for one legal move
 	if (rootLegalMoves.size() == 1 && (params.wtime != 0 || params.btime != 0)) {
@@ -93,9 +191,18 @@ void Search::StartSearch(Position& position, const SearchParams params) {
 		Constraints.SearchTimeMax = std::min(Constraints.SearchTimeMax, 2000);
 	}
 
+	// The hard limit of nodestime is a node limit instead of a deadline
+	if (Constraints.NodesPerMs != 0) Constraints.MaxNodes = static_cast<int64_t>(Constraints.SearchTimeMax) * Constraints.NodesPerMs;
+
 	// Fire up the threads
+	ResetNodeCounter(static_cast<int>(Threads.size()));
 	Aborting.store(false);
+	Pondering.store(params.ponder);
+	MoveClockStartTime = StartSearchTime;
+	if (Constraints.SearchTimeMax != -1 && !params.ponder) ArmDeadline(Constraints.SearchTimeMax);
 	ActiveThreadCount.store(Threads.size());
+	SharedSearch = Threads.size() > 1;
+	BusyMoves.Clear();
 	for (ThreadData& t : Threads) {
 		t.CurrentPosition = position;
 		t.result = {};
@@ -111,11 +218,24 @@ void Search::StartSearch(Position& position, const SearchParams params) {
 
 void Search::StopSearch() {
 	Aborting.store(true);
+	NotifyPool();
 	WaitUntilReady();
+	Pondering.store(false);
+}
+
+// The opponent played the expected move, the ponder search continues as a normal search
+// The time limits are still measured from the 'go ponder' command, so the time spent pondering is credited
+// towards this move: after a long ponder the move is often played right away
+void Search::PonderHit() {
+	Pondering.store(false);
+	MoveClockStartTime = Clock::now();
+	if (Constraints.SearchTimeMax != -1) ArmDeadline(Constraints.SearchTimeMax);
+	NotifyPool();
 }
 
 void Search::Loop(ThreadData& t) {
 	LoadedThreadCount.fetch_add(1);
+	NotifyPool();
 
 	while (true) {
 
@@ -124,19 +244,31 @@ void Search::Loop(ThreadData& t) {
 
 		if (t.Action == ThreadAction::Exit) break;
 		else {
+			t.WokenAt = Clock::now();
 			SearchMoves(t);
-			if (t.IsMainThread()) PrintBestmove(t.result.BestMove());
+			if (t.IsMainThread()) {
+				DisarmDeadline();
+				if (Constraints.NodesPerMs != 0) ChargeNodesTime();
+				if (!Silent) {
+					ReportTimeUsage();
+					const ThreadData& bestThread = SelectBestThread();
+					PrintBestmove(bestThread.result.BestMove(), GetPonderMove(bestThread));
+				}
+			}
+			t.FinishedAt = Clock::now();
 		}
 
 		t.Action = ThreadAction::Sleep;
 		ActiveThreadCount.fetch_sub(1);
-		t.CondVar.notify_one();
+		NotifyPool();
+		t.CondVar.notify_all();
 	}
 
 	std::unique_lock<std::mutex> lock(t.Mutex);
 	t.Exited = true;
 	lock.unlock();
 	t.CondVar.notify_all();
+	LoadedThreadCount.fetch_sub(1);
 }
 
 void Search::WaitUntilReady() {
@@ -152,21 +284,27 @@ void Search::WaitUntilReady() {
 SearchConstraints Search::CalculateConstraints(const SearchParams params, const bool turn) const {
 	SearchConstraints constraints;
 
+	// The move overhead accounts for the time lost communicating with the GUI (and over the network)
+	const auto subtractOverhead = [](const int time) { return std::max(time - Settings::MoveOverhead, 1); };
+
 	// Handle nodes, depth, movetime 
 	if (params.nodes != 0) constraints.MaxNodes = params.nodes;
 	if (params.softnodes != 0) constraints.SoftNodes = params.softnodes;
 	if (params.depth != 0) constraints.MaxDepth = params.depth;
 	if (params.movetime != 0) {
-		constraints.SearchTimeMin = params.movetime;
-		constraints.SearchTimeMax = params.movetime;
+		constraints.SearchTimeMin = subtractOverhead(params.movetime);
+		constraints.SearchTimeMax = subtractOverhead(params.movetime);
 	}
 	if (constraints.MaxDepth != -1 || constraints.MaxNodes != -1) return constraints;
 	if (constraints.SearchTimeMin != -1 || constraints.SearchTimeMax != -1) return constraints;
 
 	// Handle wtime, btime, winc, binc
-	const int myTime = turn ? params.wtime : params.btime;
+	const int clockTime = turn ? params.wtime : params.btime;
 	const int myInc = turn ? params.winc : params.binc;
-	if (myTime != 0) {
+	if (clockTime != 0) {
+		// Communication delays don't affect a node budget
+		if (Settings::NodesTime != 0) constraints.NodesPerMs = Settings::NodesTime;
+		const int myTime = (constraints.NodesPerMs != 0) ? clockTime : subtractOverhead(clockTime);
 		int minTime, maxTime;
 
 		if (params.movestogo > 0) {
@@ -190,27 +328,112 @@ SearchConstraints Search::CalculateConstraints(const SearchParams params, const
 	return constraints;
 }
 
-bool Search::ShouldAbort(const ThreadData& t) {
+bool Search::ShouldAbort(ThreadData& t) {
 	if (Aborting.load(std::memory_order_relaxed) && (t.RootDepth > 1 || !t.IsMainThread())) return true;
-	if (!t.IsMainThread()) return false; // TODO: ensure limits when multithreaded
 
-	if (Constraints.MaxNodes != -1 && t.Nodes >= Constraints.MaxNodes && t.RootDepth > 1) {
-		Aborting.store(true, std::memory_order_relaxed);
+	// Node limits apply to the total of all threads
+	if (t.Nodes - t.PublishedNodes >= NodeBatchSize) {
+		TotalNodes.Nodes.fetch_add(t.Nodes - t.PublishedNodes, std::memory_order_relaxed);
+		t.PublishedNodes = t.Nodes;
+	}
+	if (Constraints.MaxNodes != -1 && t.RootDepth > 1 && CountNodes(t) >= Constraints.MaxNodes) {
+		// Happens once per search, the main thread may be waiting on the pool (e.g. when pondering)
+		if (!Aborting.exchange(true)) NotifyPool();
 		return true;
 	}
-	if (t.Nodes % 1024 == 0 && Constraints.SearchTimeMax != -1 && t.RootDepth > 1) {
-		const auto now = Clock::now();
-		const int elapsedMs = static_cast<int>((now - StartSearchTime).count() / 1e6);
-		if (elapsedMs >= Constraints.SearchTimeMax) {
-			Aborting.store(true, std::memory_order_relaxed);
-			return true;
+
+	return false;
+}
+
+// Timekeeping ------------------------------------------------------------------------------------
+// The hard time limit is enforced by a separate thread, which sleeps until the deadline and sets the abort
+// flag exactly then: this keeps clock reads out of the search, and works even if a search thread is slow
+// to get back to checking the limits (e.g. when it's descheduled under load)
+// Arming replaces the previous deadline, and it's disarmed when the search ends, so a deadline can't leak
+// into the next search
+
+void Search::TimekeeperLoop() {
+	std::unique_lock<std::mutex> lock(TimekeeperMutex);
+	while (!TimekeeperExit) {
+		if (!Deadline.has_value()) {
+			TimekeeperCondVar.wait(lock);
+			continue;
+		}
+		TimekeeperCondVar.wait_until(lock, Deadline.value());
+		if (Deadline.has_value() && Clock::now() >= Deadline.value()) {
+			Deadline = std::nullopt;
+			Aborting.store(true);
+			NotifyPool();
 		}
 	}
-	return false;
+}
+
+// Sets the deadline to the given time after the start of the search (with nodestime there's no deadline)
+void Search::ArmDeadline(const int searchTimeMs) {
+	if (Constraints.NodesPerMs != 0) return;
+	std::unique_lock<std::mutex> lock(TimekeeperMutex);
+	Deadline = StartSearchTime + std::chrono::milliseconds(searchTimeMs);
+	lock.unlock();
+	TimekeeperCondVar.notify_one();
+}
+
+void Search::DisarmDeadline() {
+	std::unique_lock<std::mutex> lock(TimekeeperMutex);
+	Deadline = std::nullopt;
+	lock.unlock();
+	TimekeeperCondVar.notify_one();
+}
+
+// Logs how long the move took compared to the hard limit, so overshooting under load can be noticed
+// After a ponderhit only the time since then is on our clock, but the limits are still measured from the start
+void Search::ReportTimeUsage() const {
+	if (Constraints.SearchTimeMax == -1) return;
+	if (Constraints.NodesPerMs != 0) {
+		int64_t nodes = 0;
+		for (const ThreadData& t : Threads) nodes += t.Nodes;
+		cout << "info string Nodes used " << nodes << ", limits " << Constraints.SearchTimeMin * Constraints.NodesPerMs
+			<< "-" << Constraints.MaxNodes << ", budget left " << NodesTimeLeft << " (nodestime " << Constraints.NodesPerMs << ")" << endl;
+		return;
+	}
+	const auto now = Clock::now();
+	const int usedMs = static_cast<int>((now - MoveClockStartTime).count() / 1e6);
+	const int elapsedMs = static_cast<int>((now - StartSearchTime).count() / 1e6);
+	cout << "info string Time used " << usedMs << " ms, limits " << Constraints.SearchTimeMin << "-" << Constraints.SearchTimeMax
+		<< " ms, overshoot " << std::clamp(elapsedMs - Constraints.SearchTimeMax, 0, usedMs) << " ms (move overhead " << Settings::MoveOverhead << " ms)" << endl;
+}
+
+// Node counting ----------------------------------------------------------------------------------
+// Each thread counts its nodes on its own, and adds them to the shared counter in batches, so the threads
+// don't contend for the same cache line on every node
+// A thread sees its own nodes exactly and the others' up to their last batch, so a limit is overshot by
+// at most a batch per thread: batches are made smaller for small limits to keep that under ~1.5%
+
+void Search::ResetNodeCounter(const int threadCount) {
+	TotalNodes.Nodes.store(0);
+	if (Constraints.MaxNodes == -1 && Constraints.SoftNodes == -1) NodeBatchSize = 1024;
+	else {
+		const int64_t limit = (Constraints.MaxNodes != -1) ? Constraints.MaxNodes : Constraints.SoftNodes;
+		NodeBatchSize = std::clamp<int64_t>(limit / (64 * threadCount), 1, 1024);
+	}
+}
+
+// Called after the search with nodestime, the other threads have already stopped
+void Search::ChargeNodesTime() {
+	int64_t nodes = 0;
+	for (const ThreadData& t : Threads) nodes += t.Nodes;
+	NodesTimeLeft = std::max<int64_t>(NodesTimeLeft - nodes, 0) + NodesTimeIncrement;
+}
+
+int64_t Search::CountNodes(const ThreadData& t) const {
+	return TotalNodes.Nodes.load(std::memory_order_relaxed) + (t.Nodes - t.PublishedNodes);
 }
 
 // Alpha-beta search routine and handling ---------------------------------------------------------
 
+// Depth skipping patterns for the helper threads
+constexpr std::array<int, 20> HelperSkipSize = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+constexpr std::array<int, 20> HelperSkipPhase = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
 void Search::SearchMoves(ThreadData& t) {
 
 	// Reset before starting (takes a fraction of a millisecond)
@@ -219,58 +442,93 @@ void Search::SearchMoves(ThreadData& t) {
 	t.ResetPVTable();
 	std::fill(t.ExcludedMoves.begin(), t.ExcludedMoves.end(), NullMove);
 	std::fill(t.CutoffCount.begin(), t.CutoffCount.end(), 0);
-	std::memset(&t.RootNodeCounts, 0, sizeof(t.RootNodeCounts));
 	t.History.ClearRefutations();
+	t.EvalState.Net = &NetworkForNode(t.NumaNode);
 	t.EvalState.Reset(t.CurrentPosition);
+	InitializeRootMoves(t);
 
 	Move previousBestMove = NullMove;
 	int bestMoveStability = 0;
 
+	// With MultiPV each iteration searches the lines one after another, sharing the TT and the histories
+	const int lineCount = std::clamp(static_cast<int>(t.RootMoves.size()), 1, Settings::MultiPV);
+	std::vector<RootLine> lines(lineCount);
+	t.Lines.clear();
+
 	// Iterative deepening
 	t.result.ply = t.CurrentPosition.GetPly();
-	int score = NoEval;
 	bool finished = false;
 
 	while (!finished) {
-		t.ResetPVTable();
 		t.RootDepth += 1;
-		t.SelDepth = 0;
 
-		if (t.RootDepth < 5) {
-			// Regular negamax for very shallow depths
-			score = SearchRecursive<true>(t, t.RootDepth, 0, NegativeInfinity, PositiveInfinity, false);
+		// Helper threads skip some depths in different patterns, so that they are spread over adjacent depths
+		// instead of all of them searching the same iteration (the last allowed depth is never skipped)
+		const int depthLimit = Constraints.MaxDepth != -1 ? std::min(Constraints.MaxDepth, MaxDepth) : MaxDepth;
+		if (!t.IsMainThread() && t.RootDepth > 1 && t.RootDepth < depthLimit) {
+			const int i = (t.threadId - 1) % 20;
+			if (((t.RootDepth + t.result.ply + HelperSkipPhase[i]) / HelperSkipSize[i]) % 2 != 0) continue;
 		}
-		else {
-			// Aspiration windows for higher depths
-			int windowSize = 12;
-			int searchDepth = t.RootDepth;
-			int alpha = std::max(score - windowSize, NegativeInfinity);
-			int beta = std::min(score + windowSize, PositiveInfinity);
 
-			while (true) {
-				if (Aborting.load(std::memory_order_relaxed)) break;
+		t.SelDepth = 0;
+		t.RootExcludedMoves.clear();
+		for (RootMove& rm : t.RootMoves) {
+			rm.score = NoEval;
+			rm.scoreType = ScoreType::UpperBound;
+		}
 
-				score = SearchRecursive<true>(t, searchDepth, 0, alpha, beta, false);
+		for (int pvIndex = 0; pvIndex < lineCount; pvIndex++) {
+			t.ResetPVTable();
+			t.PVIndex = pvIndex;
+			int& score = lines[pvIndex].score;
 
-				if (score <= alpha) {
-					alpha = std::max(alpha - windowSize, NegativeInfinity);
-					beta = (alpha + beta) / 2;
-					searchDepth = t.RootDepth;
-				}
-				else if (score >= beta) {
-					beta = std::min(beta + windowSize, PositiveInfinity);
-					if (!IsMateScore(score) && searchDepth > t.RootDepth - 3) searchDepth -= 1;  // Reduce depth on fail-high
-				}
-				else {
-					break;  // Success!
+			if (t.RootDepth < 5) {
+				// Regular negamax for very shallow depths
+				score = SearchRecursive<true>(t, t.RootDepth, 0, NegativeInfinity, PositiveInfinity, false);
+			}
+			else {
+				// Aspiration windows for higher depths, centered on the line's score in the previous iteration
+				int windowSize = 12;
+				int searchDepth = t.RootDepth;
+				int alpha = std::max(score - windowSize, NegativeInfinity);
+				int beta = std::min(score + windowSize, PositiveInfinity);
+
+				while (true) {
+					if (Aborting.load(std::memory_order_relaxed)) break;
+
+					score = SearchRecursive<true>(t, searchDepth, 0, alpha, beta, false);
+
+					if (score <= alpha) {
+						alpha = std::max(alpha - windowSize, NegativeInfinity);
+						beta = (alpha + beta) / 2;
+						searchDepth = t.RootDepth;
+					}
+					else if (score >= beta) {
+						beta = std::min(beta + windowSize, PositiveInfinity);
+						if (!IsMateScore(score) && searchDepth > t.RootDepth - 3) searchDepth -= 1;  // Reduce depth on fail-high
+					}
+					else {
+						break;  // Success!
+					}
+
+					windowSize += windowSize / 3;
 				}
-
-				windowSize += windowSize / 3;
 			}
 
+			lines[pvIndex].pv = t.GeneratePVLine();
+			if (Aborting.load(std::memory_order_relaxed)) break;
+			if (!lines[pvIndex].pv.empty()) t.RootExcludedMoves.push(lines[pvIndex].pv[0]);
 		}
 
-		const Move& bestMove = (t.PrincipalVariationTable[0].pvLine.size() > 0) ? t.PrincipalVariationTable[0].pvLine[0] : NullMove;
+		// A later line may turn out better than an earlier one, the best one is always played
+		const bool aborting = Aborting.load(std::memory_order_relaxed);
+		if (!aborting) {
+			std::stable_sort(lines.begin(), lines.end(), [](const RootLine& a, const RootLine& b) { return a.score > b.score; });
+			t.SortRootMoves();
+		}
+		const int score = lines[0].score;
+
+		const Move& bestMove = (lines[0].pv.size() > 0) ? lines[0].pv[0] : NullMove;
 		if (previousBestMove == bestMove) {
 			bestMoveStability += 1;
 		}
@@ -282,13 +540,16 @@ void Search::SearchMoves(ThreadData& t) {
 		// Check search limits on the main thread
 		const auto currentTime = Clock::now();
 		const int elapsedMs = static_cast<int>((currentTime - StartSearchTime).count() / 1e6);
-		if (t.IsMainThread() && Constraints.SearchTimeMin != -1) {
+		const int limitElapsedMs = (Constraints.NodesPerMs != 0) ? static_cast<int>(CountNodes(t) / Constraints.NodesPerMs) : elapsedMs;
+		if (t.IsMainThread() && Constraints.SearchTimeMin != -1 && !Pondering.load(std::memory_order_relaxed)) {
 			int softTimeLimit = Constraints.SearchTimeMin;
 			if (Constraints.SearchTimeMin != Constraints.SearchTimeMax) {
 				const double multiplier = [&] {
 					if (t.RootDepth <= 8) return 1.0;
 					// Root node counts:
-					const double bestMoveFraction = t.RootNodeCounts[bestMove.from][bestMove.to] / static_cast<double>(t.Nodes);
+					const RootMove* bestRootMove = t.FindRootMove(bestMove);
+					const uint64_t bestMoveNodes = (bestRootMove != nullptr) ? bestRootMove->nodes : 0;
+					const double bestMoveFraction = bestMoveNodes / static_cast<double>(t.Nodes);
 					const double nodeCountMultiplier = 2.5 - 2.0 * bestMoveFraction;
 					// Best move stability:
 					const double stabilityMultiplier = 0.8 + 1.2 * std::pow(0.4, bestMoveStability);
@@ -296,15 +557,16 @@ void Search::SearchMoves(ThreadData& t) {
 				}();
 				softTimeLimit *= multiplier;
 			}
-			if (elapsedMs >= softTimeLimit) finished = true;
+			if (limitElapsedMs >= softTimeLimit) finished = true;
 		}
 
 		if (t.RootDepth >= Constraints.MaxDepth && Constraints.MaxDepth != -1) finished = true;
 		if (t.RootDepth >= MaxDepth) finished = true;
-		if (t.Nodes >= Constraints.SoftNodes && Constraints.SoftNodes != -1) finished = true;
+		if (Constraints.SoftNodes != -1 && CountNodes(t) >= Constraints.SoftNodes) finished = true;
 
-		const bool aborting = Aborting.load(std::memory_order_relaxed);
-		if (aborting && !t.singlethreaded && t.RootDepth > 1) {
+		// The main thread is never aborted during the first iteration, but helpers are, and their unfinished
+		// iterations must not be saved
+		if (aborting && !t.singlethreaded && (t.RootDepth > 1 || !t.IsMainThread())) {
 			t.result.nodes = t.Nodes;
 			t.result.time = elapsedMs;
 			t.result.nps = static_cast<uint64_t>(t.Nodes * 1e9 / (currentTime - StartSearchTime).count());
@@ -316,7 +578,8 @@ void Search::SearchMoves(ThreadData& t) {
 		if (!t.singlethreaded || !aborting) {
 			t.result.score = score;
 			t.result.depth = t.RootDepth;
-			t.result.pv = t.GeneratePVLine();
+			t.result.pv = lines[0].pv;
+			t.Lines = lines;
 		}
 		t.result.seldepth = t.SelDepth;
 		t.result.nodes = t.Nodes;
@@ -325,31 +588,36 @@ void Search::SearchMoves(ThreadData& t) {
 		t.result.hashfull = TranspositionTable.GetHashfull();
 
 		// Display search information
-		if (t.IsMainThread() && !t.singlethreaded) {
-			if (!finished) PrintInfo(AggregateThreadResults());
+		if (t.IsMainThread() && !t.singlethreaded && !Silent) {
+			if (!finished) PrintSearchInfo(t);
 		}
 	}
 
 	// Main thread should wait others finishing before displaying the final best move
+	// When pondering, the best move can only be sent after the GUI tells the outcome (ponderhit or stop)
 	if (t.IsMainThread() && !t.singlethreaded) {
+		std::unique_lock<std::mutex> lock(PoolMutex);
+		PoolCondVar.wait(lock, [&] { return !Pondering.load() || Aborting.load(); });
 		Aborting.store(true);
-		while (ActiveThreadCount.load() > 1) { std::this_thread::yield(); }
-		PrintInfo(AggregateThreadResults());
+		PoolCondVar.wait(lock, [&] { return ActiveThreadCount.load() == 1; });
+		lock.unlock();
+		if (!Silent) PrintSearchInfo(SelectBestThread());
 	}
 }
 
-Results Search::AggregateThreadResults() const {
+// Combines the line found by the given thread with the statistics of all threads
+Results Search::AggregateThreadResults(const ThreadData& t) const {
 	Results sumResult{};
 
-	// Values from the main
-	sumResult.depth = Threads.front().result.depth;
-	sumResult.score = Threads.front().result.score;
-	sumResult.ply = Threads.front().result.ply;
-	sumResult.pv = Threads.front().result.pv;
+	// Values from the given thread
+	sumResult.depth = t.result.depth;
+	sumResult.score = t.result.score;
+	sumResult.ply = t.result.ply;
+	sumResult.pv = t.result.pv;
 
 	// Values from multiple threads
-	for (const ThreadData& t : Threads) sumResult.seldepth = std::max(sumResult.seldepth, t.SelDepth);
-	for (const ThreadData& t : Threads) sumResult.nodes += t.Nodes;
+	for (const ThreadData& thread : Threads) sumResult.seldepth = std::max(sumResult.seldepth, thread.SelDepth);
+	for (const ThreadData& thread : Threads) sumResult.nodes += thread.Nodes;
 
 	// Other data
 	const auto currentTime = Clock::now();
@@ -363,6 +631,149 @@ Results Search::AggregateThreadResults() const {
 	return sumResult;
 }
 
+// The reply we expect from the opponent, for pondering on it: the second move of the PV, or if the PV was
+// cut short (e.g. by a TT cutoff), the TT move of the position after our move, if it's legal there
+Move Search::GetPonderMove(const ThreadData& t) const {
+	const std::vector<Move>& pv = t.result.pv;
+	if (pv.size() >= 2) return pv[1];
+	if (pv.size() == 0) return NullMove;
+
+	Position position = t.CurrentPosition;
+	position.PushMove(pv[0]);
+	TranspositionEntry ttEntry;
+	if (!TranspositionTable.Probe(position.Hash(), ttEntry, 0)) return NullMove;
+
+	const Move ttMove = Move(ttEntry.packedMove);
+	MoveList legalMoves{};
+	position.GenerateAllLegalMoves(legalMoves);
+	const bool legal = std::any_of(legalMoves.begin(), legalMoves.end(), [&](const ScoredMove& sm) { return sm.move == ttMove; });
+	return legal ? ttMove : NullMove;
+}
+
+// The threads vote for the best moves they found in their last completed iteration, weighted by the depth
+// and by how much the score exceeds the lowest one, this way a helper that got deeper or found something better
+// can overrule the main thread (with MultiPV the main thread's lines are always used)
+const ThreadData& Search::SelectBestThread() const {
+	const ThreadData& mainThread = Threads.front();
+	if (Threads.size() == 1 || Settings::MultiPV != 1) return mainThread;
+
+	const auto hasResult = [](const ThreadData& t) {
+		return !t.result.pv.empty() && t.result.depth > 0 && std::abs(t.result.score) < MateEval;
+	};
+	int minScore = PositiveInfinity;
+	for (const ThreadData& t : Threads) {
+		if (hasResult(t)) minScore = std::min(minScore, t.result.score);
+	}
+	const auto votesFor = [&](const Move& m) {
+		int64_t votes = 0;
+		for (const ThreadData& t : Threads) {
+			if (hasResult(t) && t.result.BestMove() == m) votes += static_cast<int64_t>(t.result.score - minScore + 14) * t.result.depth;
+		}
+		return votes;
+	};
+
+	const ThreadData* bestThread = &mainThread;
+	int64_t bestVotes = hasResult(mainThread) ? votesFor(mainThread.result.BestMove()) : -1;
+	for (const ThreadData& t : Threads) {
+		if (&t == &mainThread || !hasResult(t)) continue;
+		const int64_t votes = votesFor(t.result.BestMove());
+
+		// Mate scores are not averaged out: the fastest mate (or the slowest loss) is played
+		if (IsMateScore(bestThread->result.score) || IsMateScore(t.result.score)) {
+			if (t.result.score > bestThread->result.score) {
+				bestThread = &t;
+				bestVotes = votes;
+			}
+			continue;
+		}
+		if (votes > bestVotes || (votes == bestVotes && t.result.depth > bestThread->result.depth)) {
+			bestThread = &t;
+			bestVotes = votes;
+		}
+	}
+	return *bestThread;
+}
+
+// Results of the last search, as they would be reported
+Results Search::GetSearchResults() const {
+	return AggregateThreadResults(SelectBestThread());
+}
+
+// Prints the aggregated results with the given thread's line, and with MultiPV an info line for each of its lines
+void Search::PrintSearchInfo(const ThreadData& t) const {
+	const Results results = AggregateThreadResults(t);
+	if (Settings::MultiPV == 1) {
+		PrintInfo(results);
+		return;
+	}
+
+	const std::vector<RootLine>& lines = t.Lines;
+	for (std::size_t i = 0; i < lines.size(); i++) {
+		Results line = results;
+		line.multiPV = static_cast<int>(i + 1);
+		line.score = lines[i].score;
+		line.pv = lines[i].pv;
+		PrintInfo(line);
+	}
+}
+
+// Collects the legal root moves (or the ones given by searchmoves), initially in the usual move ordering
+void Search::InitializeRootMoves(ThreadData& t) {
+	const Position& position = t.CurrentPosition;
+	MoveList legalMoves{};
+	position.GenerateAllLegalMoves(legalMoves);
+	const auto isAllowed = [&](const Move& m) {
+		const bool legal = std::any_of(legalMoves.begin(), legalMoves.end(), [&](const ScoredMove& sm) { return sm.move == m; });
+		const bool filtered = !RootMoveFilter.empty() && std::find(RootMoveFilter.begin(), RootMoveFilter.end(), m) == RootMoveFilter.end();
+		return legal && !filtered;
+	};
+
+	TranspositionEntry ttEntry;
+	const bool found = TranspositionTable.Probe(position.Hash(), ttEntry, 0);
+	const Move ttMove = found ? Move(ttEntry.packedMove) : NullMove;
+
+	t.RootMoves.clear();
+	MovePicker movePicker{};
+	movePicker.initialize(false, position, t.History, ttMove, 0);
+	while (true) {
+		const auto& [m, order] = movePicker.next(position, t.History);
+		if (m == NullMove) break;
+		if (isAllowed(m)) t.RootMoves.push_back(RootMove{ .move = m, .rank = static_cast<int>(t.RootMoves.size()) });
+	}
+}
+
+// GUIs show the move being searched at the root, this is only sent for longer searches to avoid flooding them
+void Search::ReportCurrentMove(const ThreadData& t, const Move& m, const int moveNumber) const {
+	if (!t.IsMainThread() || t.singlethreaded || Silent || !Settings::UseUCI) return;
+	const int elapsedMs = static_cast<int>((Clock::now() - StartSearchTime).count() / 1e6);
+	if (elapsedMs < 3000) return;
+	cout << "info depth " << t.RootDepth << " currmove " << m.ToString(Settings::Chess960) << " currmovenumber " << moveNumber << endl;
+}
+
+// Prints the root moves of the main thread's last search, in the order they would be searched next
+void Search::PrintRootMoves() const {
+	const ThreadData& t = Threads.front();
+	cout << "-> Root moves (" << t.RootMoves.size() << "):" << endl;
+	for (const RootMove& rm : t.RootMoves) {
+		cout << "   " << std::setw(3) << rm.rank + 1 << ". " << std::setw(5) << std::left << rm.move.ToString(Settings::Chess960) << std::right;
+		// Moves that failed low only have their move and node count printed, their line is from an earlier iteration
+		const bool failedLow = (rm.score == NoEval) || (rm.scoreType == ScoreType::UpperBound);
+		const std::string score = [&]() -> std::string {
+			if (failedLow) return "-";
+			const std::string bound = (rm.scoreType == ScoreType::LowerBound) ? ">= " : "";
+			if (!IsMateScore(rm.score)) return bound + std::to_string(ToCentipawns(rm.score, t.result.ply)) + " cp";
+			const int movesToMate = (MateEval - std::abs(rm.score) + 1) / 2;
+			return bound + "mate " + (rm.score > 0 ? "" : "-") + std::to_string(movesToMate);
+		}();
+		cout << std::setw(16) << score;
+		cout << std::setw(16) << Console::FormatInteger(rm.nodes) << " nodes ";
+		if (!failedLow) {
+			for (const Move& m : rm.pv) cout << " " << m.ToString(Settings::Chess960);
+		}
+		cout << endl;
+	}
+}
+
 // The primary alpha-beta search function of the engine
 // Recursively calls itself until depth reaches 0, and then it initiates a quiescence search in leaf nodes
 template<bool pvNode>
@@ -499,17 +910,41 @@ int Search::SearchRecursive(ThreadData& t, int depth, const int level, int alpha
 	int failHighCount = 0;
 	int bestScore = NegativeInfinity;
 	Move bestMove = NullMove;
+	int rootMoveIndex = 0;
 
 	StaticVector<Move, MaxMoveCount> quietsTried;
 	StaticVector<Move, MaxMoveCount> capturesTried;
 
+	const bool deferBusyMoves = SharedSearch && !t.singlethreaded && !pvNode && !singularSearch && depth >= BusyMoveTable::MinDepth;
+	StaticVector<ScoredMove, BusyMoveTable::MaxDeferredMoves> deferredMoves;
+	std::size_t deferredIndex = 0;
+
 	while (true) {
-		const auto& [m, order] = movePicker.next(position, t.History);
+		// At the root the moves come from the root move list, ordered by the previous iteration
+		// After the move picker runs out, the moves deferred because of the other threads are searched
+		auto [m, order] = rootNode ? t.NextRootMove(rootMoveIndex) : movePicker.next(position, t.History);
+		const bool deferredMove = (m == NullMove) && (deferredIndex < deferredMoves.size());
+		if (deferredMove) {
+			m = deferredMoves[deferredIndex].move;
+			order = deferredMoves[deferredIndex].orderScore;
+			deferredIndex += 1;
+		}
 		if (m == NullMove) break;
 
 		if (m == excludedMove) continue;
+		if (rootNode && t.IsRootMoveExcluded(m)) continue;
 		const bool isQuiet = position.IsMoveQuiet(m);
+		if (deferredMove && isQuiet && movePicker.skipQuietMoves) continue;
+
+		// Defer the move if another thread is searching it (the first move is always searched)
+		const uint64_t busyKey = deferBusyMoves ? BusyMoveTable::Key(hash, m) : 0;
+		if (deferBusyMoves && !deferredMove && legalMoveCount != 0 && deferredMoves.size() < BusyMoveTable::MaxDeferredMoves
+			&& BusyMoves.IsBusy(busyKey)) {
+			deferredMoves.push({ m, order });
+			continue;
+		}
 		legalMoveCount += 1;
+		if (rootNode) ReportCurrentMove(t, m, legalMoveCount + t.PVIndex);
 
 		if (isQuiet) quietsTried.push(m);
 		else capturesTried.push(m);
@@ -589,7 +1024,9 @@ int Search::SearchRecursive(ThreadData& t, int depth, const int level, int alpha
 		const uint64_t nodesBefore = t.Nodes;
 
 		TranspositionTable.Prefetch(position.ApproximateHashAfterMove(m));
+		t.PrefetchForMove(position, m, movedPiece, capturedPiece);
 		const int history = isQuiet ? t.History.GetQuietHistoryScore(position, m, movedPiece, level) : t.History.GetCaptureHistoryScore(position, m);
+		const bool markedBusy = deferBusyMoves && BusyMoves.TryMark(busyKey);
 		position.PushMove(m);
 		t.EvalState.PushState(position, m, movedPiece, capturedPiece);
 
@@ -636,9 +1073,21 @@ int Search::SearchRecursive(ThreadData& t, int depth, const int level, int alpha
 
 		position.PopMove();
 		t.EvalState.PopState();
-
-		// Update node count table for the root, this is used for time management
-		if (rootNode) t.RootNodeCounts[m.from][m.to] += t.Nodes - nodesBefore;
+		if (markedBusy) BusyMoves.Unmark(busyKey);
+
+		// Update the root move's statistics, the node counts are also used for time management
+		if (rootNode) {
+			RootMove& rootMove = t.RootMoves[rootMoveIndex - 1];
+			rootMove.nodes += t.Nodes - nodesBefore;
+			if (!Aborting.load(std::memory_order_relaxed)) {
+				rootMove.score = score;
+				rootMove.scoreType = (score <= alpha) ? ScoreType::UpperBound : (score >= beta) ? ScoreType::LowerBound : ScoreType::Exact;
+				if (score > alpha) {
+					rootMove.pv.assign(1, m);
+					for (const Move& childMove : t.PrincipalVariationTable[1].pvLine) rootMove.pv.push_back(childMove);
+				}
+			}
+		}
 
 		failLowCount += (score <= alpha);
 
@@ -704,8 +1153,12 @@ int Search::SearchRecursive(ThreadData& t, int depth, const int level, int alpha
 		}
 	}
 
+	// With MultiPV the root results of the later lines only cover some of the moves, these are not stored
+	// (the same applies when searchmoves restricts the root moves)
+	const bool partialRoot = rootNode && (t.PVIndex != 0 || !RootMoveFilter.empty());
+
 	// Update evaluation correction history
-	if (!aborting && !singularSearch) {
+	if (!aborting && !singularSearch && !partialRoot) {
 		const bool updateCorrection = [&] {
 			if (inCheck) return false;
 			if (!bestMove.IsNull() && !position.IsMoveQuiet(bestMove)) return false;
@@ -717,7 +1170,7 @@ int Search::SearchRecursive(ThreadData& t, int depth, const int level, int alpha
 	}
 
 	// Store node search results into the transposition table
-	if (!aborting && !singularSearch) {
+	if (!aborting && !singularSearch && !partialRoot) {
 		TranspositionTable.Store(hash, depth, bestScore, scoreType, rawEval, bestMove, level, ttPV);
 	}
 
@@ -749,6 +1202,17 @@ int Search::SearchQuiescence(ThreadData& t, const int level, int alpha, int beta
 
 	// Get node evaluation
 	const bool inCheck = position.IsInCheck();
+
+	// Hybrid evaluation: when the classical evaluation is far above beta, the stand pat cutoff is taken without
+	// running the network (the classical score is in centipawns, see HybridEvalScale)
+	if (Settings::HybridEvalThreshold != 0 && !pvNode && !inCheck && !found) {
+		const int classicalEval = ClassicalEvaluate(position) * Settings::HybridEvalScale / 100;
+		if (classicalEval - Settings::HybridEvalThreshold >= beta) {
+			t.HybridCounters.Classical += 1;
+			return std::min(classicalEval - Settings::HybridEvalThreshold, MateThreshold - 1);
+		}
+	}
+
 	const int rawEval = [&] {
 		if (inCheck) return static_cast<int16_t>(NoEval);
 		if (found) return ttEntry.rawEval;
@@ -796,6 +1260,7 @@ int Search::SearchQuiescence(ThreadData& t, const int level, int alpha, int beta
 		const uint8_t movedPiece = position.GetPieceAt(m.from);
 		const uint8_t capturedPiece = position.GetPieceAt(m.to);
 		TranspositionTable.Prefetch(position.ApproximateHashAfterMove(m));
+		t.PrefetchForMove(position, m, movedPiece, capturedPiece);
 		position.PushMove(m);
 		t.EvalState.PushState(position, m, movedPiece, capturedPiece);
 		const int score = -SearchQuiescence<pvNode>(t, level + 1, -beta, -alpha);
@@ -825,6 +1290,7 @@ int Search::SearchQuiescence(ThreadData& t, const int level, int alpha, int beta
 }
 
 int16_t Search::Evaluate(ThreadData& t, const Position& position) {
+	t.HybridCounters.Network += 1;
 	return t.EvalState.Evaluate(position);
 }
 
@@ -847,3 +1313,30 @@ std::vector<Move> ThreadData::GeneratePVLine() const {
 void ThreadData::ResetPVTable() {
 	std::memset(&PrincipalVariationTable, 0, sizeof(PrincipalVariationTable));
 }
+
+// Moves that raised alpha in the last iteration come first by their scores, then the rest by their subtree sizes
+// (a move that took more effort to refute is more likely to become the best one)
+void ThreadData::SortRootMoves() {
+	std::stable_sort(RootMoves.begin(), RootMoves.end(), [](const RootMove& a, const RootMove& b) {
+		const bool aRaisedAlpha = a.scoreType != ScoreType::UpperBound;
+		const bool bRaisedAlpha = b.scoreType != ScoreType::UpperBound;
+		if (aRaisedAlpha != bRaisedAlpha) return aRaisedAlpha;
+		if (aRaisedAlpha) return a.score > b.score;
+		return a.nodes > b.nodes;
+	});
+	for (int i = 0; i < static_cast<int>(RootMoves.size()); i++) RootMoves[i].rank = i;
+}
+
+const RootMove* ThreadData::FindRootMove(const Move& m) const {
+	for (const RootMove& rm : RootMoves) {
+		if (rm.move == m) return &rm;
+	}
+	return nullptr;
+}
+
+bool ThreadData::IsRootMoveExcluded(const Move& m) const {
+	for (const Move& excluded : RootExcludedMoves) {
+		if (excluded == m) return true;
+	}
+	return false;
+}
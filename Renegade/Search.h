@@ -13,6 +13,7 @@
 #include <fstream>
 #include <list>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <tuple>
 
@@ -21,22 +22,118 @@
 
 enum class ThreadAction { Sleep, Search, Exit };
 
+// How often qsearch nodes were resolved by the classical evaluation without running the network
+struct HybridEvalCounters {
+	uint64_t Classical = 0;  // stand pat cutoff from the classical evaluation alone
+	uint64_t Network = 0;    // network evaluations (including the ones served by the eval cache)
+
+	HybridEvalCounters& operator+=(const HybridEvalCounters& other) {
+		Classical += other.Classical;
+		Network += other.Network;
+		return *this;
+	}
+};
+
+// How many weight rows and history slots were requested ahead of making moves
+struct PrefetchCounters {
+	uint64_t WeightRows = 0;
+	uint64_t HistorySlots = 0;
+
+	PrefetchCounters& operator+=(const PrefetchCounters& other) {
+		WeightRows += other.WeightRows;
+		HistorySlots += other.HistorySlots;
+		return *this;
+	}
+};
+
+// Node count shared by the threads, on its own cache line so that it doesn't share it with anything else
+struct alignas(64) SharedNodeCounter {
+	std::atomic<int64_t> Nodes = 0;
+};
+
+// ABDADA: the moves currently being searched by some thread, each keyed by the position's hash and the move
+// At non-PV nodes a move another thread is busy with is deferred, and is only searched after the other moves,
+// by which time the other thread's result is likely in the TT, or a cutoff made searching it unnecessary
+// Collisions only make the scheme less effective, a slot is simply not used if it's taken
+class BusyMoveTable {
+public:
+	static constexpr int Size = 4096;
+	static constexpr int MinDepth = 5;
+	static constexpr int MaxDeferredMoves = 32;
+
+	static inline uint64_t Key(const uint64_t hash, const Move& m) {
+		const uint64_t key = hash ^ (static_cast<uint64_t>(m.Pack()) * 0x9E3779B97F4A7C15ULL);
+		return (key != 0) ? key : 1;
+	}
+	inline bool IsBusy(const uint64_t key) const {
+		return Slots[key % Size].load(std::memory_order_relaxed) == key;
+	}
+	inline bool TryMark(const uint64_t key) {
+		uint64_t expected = 0;
+		return Slots[key % Size].compare_exchange_strong(expected, key, std::memory_order_relaxed);
+	}
+	inline void Unmark(const uint64_t key) {
+		Slots[key % Size].store(0, std::memory_order_relaxed);
+	}
+	void Clear() {
+		for (std::atomic<uint64_t>& slot : Slots) slot.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, Size> Slots{};
+};
+
+// A line found by the search at the root, with MultiPV there's one for each of the best few moves
+struct RootLine {
+	int score = NoEval;
+	std::vector<Move> pv;
+};
+
+// Statistics of a move at the root, the scores are only exact for the moves raising alpha
+struct RootMove {
+	Move move;
+	int score = NoEval;
+	int scoreType = ScoreType::UpperBound;
+	int rank = 0;  // in the ordering after the previous iteration
+	uint64_t nodes = 0;
+	std::vector<Move> pv = {};
+};
+
 class alignas(64) ThreadData {
 public:
 	void ResetStatistics();
+	void PrefetchForMove(const Position& position, const Move& m, const uint8_t movedPiece, const uint8_t capturedPiece);
 
 	int RootDepth = 0, SelDepth = 0;
 	int64_t Nodes = 0;
+	int64_t PublishedNodes = 0;  // part of Nodes already added to the shared counter
 	Histories History;
 	MultiArray<PrincipalVariation, MaxDepth + 1> PrincipalVariationTable;
 	std::array<int, MaxDepth + 1> PVLength;
 	EvaluationState EvalState;
-	MultiArray<uint64_t, 64, 64> RootNodeCounts;
+	HybridEvalCounters HybridCounters;
+	PrefetchCounters Prefetches;
 
 	// PV table
 	std::vector<Move> GeneratePVLine() const;
 	void ResetPVTable();
 
+	// Root moves in the order they are searched, which is reordered after each iteration
+	std::vector<RootMove> RootMoves;
+	void SortRootMoves();
+	const RootMove* FindRootMove(const Move& m) const;
+
+	inline std::pair<Move, int> NextRootMove(int& index) const {
+		if (index == static_cast<int>(RootMoves.size())) return { NullMove, 0 };
+		return { RootMoves[index++].move, 0 };
+	}
+
+	// MultiPV: each line is searched with the root moves of the previous lines excluded
+	std::vector<RootLine> Lines;  // of the last completed iteration
+	StaticVector<Move, MaxMoveCount> RootExcludedMoves;
+	int PVIndex = 0;
+	bool IsRootMoveExcluded(const Move& m) const;
+
 	// Reused variables / stack
 	std::array<int, MaxDepth> StaticEvalStack;
 	std::array<int, MaxDepth> EvalStack;
@@ -48,6 +145,7 @@ public:
 
 	std::thread Thread;
 	int threadId;
+	int NumaNode = 0;  // where the thread runs and its data is, see Search::StartThreads
 	Results result;
 	bool singlethreaded = false;
 
@@ -60,22 +158,31 @@ public:
 	std::condition_variable CondVar;
 	ThreadAction Action;
 	bool Exited = false;
+	Clock::time_point WokenAt, FinishedAt;  // of the last search, for measuring latencies
 };
 
 class Search
 {
 public:
 	Search();
+	~Search();
 	void ResetState(const bool clearTT);
+	void ResetEvaluationState();
+	void ResetNodesTime();
 
 	void StartThreads(const int threadCount);
+	void RemoveThreads(const int threadCount);
 	void StopThreads();
 	void SetThreadCount(const int threadCount);
+	void ApplyNumaPolicy();
 	void StartSearch(Position& position, const SearchParams params);
 	void StopSearch();
+	void PonderHit();
 	void Loop(ThreadData& t);
 	Results SearchSinglethreaded(const Position& pos, const SearchParams& params);
 	void WaitUntilReady();
+	void PrintRootMoves() const;
+	Results GetSearchResults() const;
 
 #ifdef RENEGADE_DATAGEN
 	static constexpr bool DatagenMode = true;
@@ -84,14 +191,26 @@ public:
 #endif
 
 	std::atomic<bool> Aborting = true;
+	std::atomic<bool> Pondering = false;
 	Transpositions TranspositionTable;
 
 	std::list<ThreadData> Threads;
 	std::atomic<int> ActiveThreadCount = 0;
 	std::atomic<int> LoadedThreadCount = 0;
+	bool Silent = false;  // no search output, used when measuring latencies
+
+	// For waiting on the other threads: threads starting up or finishing a search, and ponderhit or stop
+	std::mutex PoolMutex;
+	std::condition_variable PoolCondVar;
 
 private:
-	Results AggregateThreadResults() const;
+	Results AggregateThreadResults(const ThreadData& t) const;
+	const ThreadData& SelectBestThread() const;
+	Move GetPonderMove(const ThreadData& t) const;
+	void NotifyPool();
+	void PrintSearchInfo(const ThreadData& t) const;
+	void InitializeRootMoves(ThreadData& t);
+	void ReportCurrentMove(const ThreadData& t, const Move& m, const int moveNumber) const;
 
 	void SearchMoves(ThreadData& t);
 	template<bool pvNode> int SearchRecursive(ThreadData& t, int depth, const int level, int alpha, int beta, const bool cutNode);
@@ -99,12 +218,35 @@ private:
 
 	int16_t Evaluate(ThreadData& t, const Position& position);
 	SearchConstraints CalculateConstraints(const SearchParams params, const bool turn) const;
-	bool ShouldAbort(const ThreadData& t);
+	bool ShouldAbort(ThreadData& t);
+
+	// Timekeeping
+	void TimekeeperLoop();
+	void ArmDeadline(const int searchTimeMs);
+	void DisarmDeadline();
+	void ReportTimeUsage() const;
+	void ChargeNodesTime();
+	int64_t CountNodes(const ThreadData& t) const;
+	void ResetNodeCounter(const int threadCount);
 	int DrawEvaluation(const ThreadData& t) const;
 
 	
 	SearchConstraints Constraints;
+	std::vector<Move> RootMoveFilter;  // set by searchmoves
+	BusyMoveTable BusyMoves;
+	bool SharedSearch = false;  // more than one thread is searching
+	SharedNodeCounter TotalNodes;
+
+	std::thread Timekeeper;
+	std::mutex TimekeeperMutex;
+	std::condition_variable TimekeeperCondVar;
+	std::optional<Clock::time_point> Deadline;
+	bool TimekeeperExit = false;
+	int64_t NodeBatchSize = 1024;
+	int64_t NodesTimeLeft = -1;  // remaining node budget of the game with nodestime
+	int64_t NodesTimeIncrement = 0;
 	std::chrono::high_resolution_clock::time_point StartSearchTime;
+	std::chrono::high_resolution_clock::time_point MoveClockStartTime; // differs when pondering
 	MultiArray<int, 32, 32> LateMoveReductionTable;
 
 };
@@ -15,6 +15,27 @@ constexpr int ThreadsDefault = 1;
 constexpr int ThreadsMax = 1024;
 constexpr bool Chess960Default = false;
 constexpr bool ShowWDLDefault = true;
+constexpr std::string_view EvalFileDefault = "<default>";
+constexpr bool NetworkHugePagesDefault = false;
+constexpr bool NetworkLockMemoryDefault = false;
+constexpr int HybridEvalThresholdMin = 0;
+constexpr int HybridEvalThresholdDefault = 0;  // disabled
+constexpr int HybridEvalThresholdMax = 10000;
+constexpr int MultiPVMin = 1;
+constexpr int MultiPVDefault = 1;
+constexpr int MultiPVMax = 256;
+constexpr bool PonderDefault = false;
+constexpr int MoveOverheadMin = 0;
+constexpr int MoveOverheadDefault = 10;
+constexpr int MoveOverheadMax = 5000;
+constexpr int NodesTimeMin = 0;
+constexpr int NodesTimeDefault = 0;  // disabled
+constexpr int NodesTimeMax = 100000;
+
+// none: the OS places threads and memory; bind: threads are pinned to nodes and the hash is interleaved
+// replicate: same as bind, but each node also gets its own copy of the network
+enum class NumaPolicy { None, Bind, Replicate };
+constexpr NumaPolicy NumaPolicyDefault = NumaPolicy::None;
 
 namespace Settings {
 	inline int Hash = HashDefault;
@@ -22,6 +43,19 @@ namespace Settings {
 	inline bool ShowWDL = ShowWDLDefault;
 	inline bool UseUCI = false;
 	inline bool Chess960 = Chess960Default;
+	inline std::string EvalFile = std::string(EvalFileDefault);
+	inline bool NetworkHugePages = NetworkHugePagesDefault;
+	inline bool NetworkLockMemory = NetworkLockMemoryDefault;
+	inline int HybridEvalThreshold = HybridEvalThresholdDefault;  // in internal units
+	// The classical evaluation is in centipawns, for the hybrid cutoff it's multiplied by this and divided by 100
+	// to get internal units, using the same normalization as ToCentipawns() at the ply of the search's root
+	inline int HybridEvalScale = 100;  // not an option, set at the start of each search
+	inline int MultiPV = MultiPVDefault;
+	inline int MoveOverhead = MoveOverheadDefault;
+	inline int NodesTime = NodesTimeDefault;  // nodes per millisecond
+	inline NumaPolicy NumaPlacement = NumaPolicyDefault;
+	inline bool Ponder = PonderDefault;  // only tells that the GUI may ask for pondering, 'go ponder' works regardless
+	inline bool SoftwarePrefetch = true;  // not an option, only turned off by benchprefetch for comparison
 }
 
 // Search parameter tuning ------------------------------------------------------------------------
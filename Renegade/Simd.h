@@ -0,0 +1,161 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define RENEGADE_SIMD_AVX512
+#elif defined(__AVX2__)
+#define RENEGADE_SIMD_AVX2
+#elif defined(__SSE2__)
+#define RENEGADE_SIMD_SSE
+#endif
+
+#if defined(RENEGADE_SIMD_AVX512) || defined(RENEGADE_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(RENEGADE_SIMD_SSE)
+#include <emmintrin.h>
+#endif
+
+// Thin wrappers around the vector instructions used by the neural network code
+// The widest instruction set enabled at compile time is picked, and the kernels in Kernels.cpp are
+// written against these, so they don't have to care about the exact target
+
+// The scalar variant is a vector of one element, this keeps the kernels free of #ifdefs and the
+// compiler is still free to autovectorize them
+
+// Everything is in an anonymous namespace, as the universal build compiles the kernels for several
+// instruction sets, and these inline functions with the same names must not be merged by the linker
+
+namespace SIMD {
+namespace {
+
+#if defined(RENEGADE_SIMD_AVX512)
+
+	using VecI16 = __m512i;
+	using VecI32 = __m512i;
+	constexpr int I16PerVec = 32;
+
+#if defined(__AVX512VNNI__)
+	constexpr std::string_view Name = "AVX-512 VNNI";
+#else
+	constexpr std::string_view Name = "AVX-512";
+#endif
+
+	inline VecI16 Zero() { return _mm512_setzero_si512(); }
+	inline VecI16 Set16(const int16_t x) { return _mm512_set1_epi16(x); }
+	inline VecI16 Load16(const int16_t* p) { return _mm512_load_si512(p); }
+	inline VecI16 Load8As16(const int8_t* p) { return _mm512_cvtepi8_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(p))); }
+	inline void Store16(int16_t* p, const VecI16 v) { _mm512_store_si512(p, v); }
+	inline VecI16 Add16(const VecI16 a, const VecI16 b) { return _mm512_add_epi16(a, b); }
+	inline VecI16 Sub16(const VecI16 a, const VecI16 b) { return _mm512_sub_epi16(a, b); }
+	inline VecI16 Min16(const VecI16 a, const VecI16 b) { return _mm512_min_epi16(a, b); }
+	inline VecI16 Max16(const VecI16 a, const VecI16 b) { return _mm512_max_epi16(a, b); }
+	inline VecI16 MulLo16(const VecI16 a, const VecI16 b) { return _mm512_mullo_epi16(a, b); }
+	inline VecI16 ShiftLeft16(const VecI16 a, const int bits) { return _mm512_slli_epi16(a, bits); }
+
+	// sum += a[0] * b[0] + a[1] * b[1] for each pair of 16-bit lanes
+	inline VecI32 MulAddPairs16(const VecI32 sum, const VecI16 a, const VecI16 b) {
+#if defined(__AVX512VNNI__)
+		return _mm512_dpwssd_epi32(sum, a, b);
+#else
+		return _mm512_add_epi32(sum, _mm512_madd_epi16(a, b));
+#endif
+	}
+
+	inline int ReduceAdd32(const VecI32 v) { return _mm512_reduce_add_epi32(v); }
+
+#elif defined(RENEGADE_SIMD_AVX2)
+
+	using VecI16 = __m256i;
+	using VecI32 = __m256i;
+	constexpr int I16PerVec = 16;
+	constexpr std::string_view Name = "AVX2";
+
+	inline VecI16 Zero() { return _mm256_setzero_si256(); }
+	inline VecI16 Set16(const int16_t x) { return _mm256_set1_epi16(x); }
+	inline VecI16 Load16(const int16_t* p) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); }
+	inline VecI16 Load8As16(const int8_t* p) { return _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(p))); }
+	inline void Store16(int16_t* p, const VecI16 v) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), v); }
+	inline VecI16 Add16(const VecI16 a, const VecI16 b) { return _mm256_add_epi16(a, b); }
+	inline VecI16 Sub16(const VecI16 a, const VecI16 b) { return _mm256_sub_epi16(a, b); }
+	inline VecI16 Min16(const VecI16 a, const VecI16 b) { return _mm256_min_epi16(a, b); }
+	inline VecI16 Max16(const VecI16 a, const VecI16 b) { return _mm256_max_epi16(a, b); }
+	inline VecI16 MulLo16(const VecI16 a, const VecI16 b) { return _mm256_mullo_epi16(a, b); }
+	inline VecI16 ShiftLeft16(const VecI16 a, const int bits) { return _mm256_slli_epi16(a, bits); }
+
+	inline VecI32 MulAddPairs16(const VecI32 sum, const VecI16 a, const VecI16 b) {
+		return _mm256_add_epi32(sum, _mm256_madd_epi16(a, b));
+	}
+
+	inline int ReduceAdd32(const VecI32 v) {
+		const auto upper_128 = _mm256_extracti128_si256(v, 1);
+		const auto lower_128 = _mm256_castsi256_si128(v);
+		const auto sum_128 = _mm_add_epi32(upper_128, lower_128);
+		const auto upper_64 = _mm_unpackhi_epi64(sum_128, sum_128);
+		const auto sum_64 = _mm_add_epi32(upper_64, sum_128);
+		const auto upper_32 = _mm_shuffle_epi32(sum_64, 0b00'00'00'01);
+		const auto sum_32 = _mm_add_epi32(upper_32, sum_64);
+		return _mm_cvtsi128_si32(sum_32);
+	}
+
+#elif defined(RENEGADE_SIMD_SSE)
+
+	// Everything needed here is already part of SSE2, so this works with the baseline x86-64 target
+	using VecI16 = __m128i;
+	using VecI32 = __m128i;
+	constexpr int I16PerVec = 8;
+	constexpr std::string_view Name = "SSE2";
+
+	inline VecI16 Zero() { return _mm_setzero_si128(); }
+	inline VecI16 Set16(const int16_t x) { return _mm_set1_epi16(x); }
+	inline VecI16 Load16(const int16_t* p) { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+	inline VecI16 Load8As16(const int8_t* p) {
+		// Sign extension without SSE4.1: duplicate each byte into the upper half, then shift it back down
+		const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+		return _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+	}
+	inline void Store16(int16_t* p, const VecI16 v) { _mm_store_si128(reinterpret_cast<__m128i*>(p), v); }
+	inline VecI16 Add16(const VecI16 a, const VecI16 b) { return _mm_add_epi16(a, b); }
+	inline VecI16 Sub16(const VecI16 a, const VecI16 b) { return _mm_sub_epi16(a, b); }
+	inline VecI16 Min16(const VecI16 a, const VecI16 b) { return _mm_min_epi16(a, b); }
+	inline VecI16 Max16(const VecI16 a, const VecI16 b) { return _mm_max_epi16(a, b); }
+	inline VecI16 MulLo16(const VecI16 a, const VecI16 b) { return _mm_mullo_epi16(a, b); }
+	inline VecI16 ShiftLeft16(const VecI16 a, const int bits) { return _mm_slli_epi16(a, bits); }
+
+	inline VecI32 MulAddPairs16(const VecI32 sum, const VecI16 a, const VecI16 b) {
+		return _mm_add_epi32(sum, _mm_madd_epi16(a, b));
+	}
+
+	inline int ReduceAdd32(const VecI32 v) {
+		const auto upper_64 = _mm_unpackhi_epi64(v, v);
+		const auto sum_64 = _mm_add_epi32(upper_64, v);
+		const auto upper_32 = _mm_shuffle_epi32(sum_64, 0b00'00'00'01);
+		const auto sum_32 = _mm_add_epi32(upper_32, sum_64);
+		return _mm_cvtsi128_si32(sum_32);
+	}
+
+#else
+
+	using VecI16 = int16_t;
+	using VecI32 = int32_t;
+	constexpr int I16PerVec = 1;
+	constexpr std::string_view Name = "scalar";
+
+	inline VecI16 Zero() { return 0; }
+	inline VecI16 Set16(const int16_t x) { return x; }
+	inline VecI16 Load16(const int16_t* p) { return *p; }
+	inline VecI16 Load8As16(const int8_t* p) { return *p; }
+	inline void Store16(int16_t* p, const VecI16 v) { *p = v; }
+	inline VecI16 Add16(const VecI16 a, const VecI16 b) { return a + b; }
+	inline VecI16 Sub16(const VecI16 a, const VecI16 b) { return a - b; }
+	inline VecI16 Min16(const VecI16 a, const VecI16 b) { return (a < b) ? a : b; }
+	inline VecI16 Max16(const VecI16 a, const VecI16 b) { return (a > b) ? a : b; }
+	inline VecI16 MulLo16(const VecI16 a, const VecI16 b) { return static_cast<int16_t>(a * b); }
+	inline VecI16 ShiftLeft16(const VecI16 a, const int bits) { return static_cast<int16_t>(a << bits); }
+	inline VecI32 MulAddPairs16(const VecI32 sum, const VecI16 a, const VecI16 b) { return sum + a * b; }
+	inline int ReduceAdd32(const VecI32 v) { return v; }
+
+#endif
+
+}
+}
@@ -110,6 +110,9 @@ void Transpositions::AllocateTable(const uint64_t clusterCount) {
 		else {
 			Table = static_cast<TranspositionCluster*>(std::aligned_alloc(64, requestedBytes));
 		}
+		// With a NUMA policy the pages are spread across the nodes, rather than all of them ending up on
+		// the node of whoever touches them first (set before clearing, which does the first touch)
+		if (Table != nullptr && Interleaved) Numa::InterleaveMemory(Table, requestedBytes);
 	#else
 		// Fall back if system is not compatible
 		Table = static_cast<TranspositionCluster*>(std::aligned_alloc(64, requestedBytes));
@@ -148,6 +151,16 @@ void Transpositions::SetSize(const int megabytes, const int threadCount) {
 	Clear(threadCount);
 }
 
+// The table is reallocated, as the memory policy is decided when the pages are first touched
+void Transpositions::SetInterleaved(const bool interleaved, const int threadCount) {
+	if (Interleaved == interleaved) return;
+	Interleaved = interleaved;
+	const uint64_t clusterCount = TableSize;
+	FreeTable();
+	AllocateTable(clusterCount);
+	Clear(threadCount);
+}
+
 // Clear entries, potentially in parallel, with as many threads as set to do search
 // This speeds up initialization significantly for large hash sizes
 void Transpositions::Clear(const int threadCount) {
@@ -1,5 +1,6 @@
 #pragma once
 #include "Move.h"
+#include "Numa.h"
 #include "Utils.h"
 #include <algorithm>
 #include <array>
@@ -54,12 +55,14 @@ public:
 	void IncreaseAge();
 	void SetSize(const int megabytes, const int threadCount);
 	void Clear(const int threadCount);
+	void SetInterleaved(const bool interleaved, const int threadCount);
 	int GetHashfull() const;
 
 private:
 	TranspositionCluster* Table = nullptr;
 	uint64_t TableSize = 0;
 	uint16_t CurrentGeneration;
+	bool Interleaved = false;  // spread across NUMA nodes
 
 	// Handles direct memory allocation and freeing, required for multiplatform and performance reasons:
 	void AllocateTable(const uint64_t clusterCount);
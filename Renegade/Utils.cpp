@@ -1,5 +1,11 @@
 #include "Utils.h"
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
 // String functions -------------------------------------------------------------------------------
 
 // Trims spaces from the beginning and end of a std::string
@@ -83,3 +89,81 @@ int ToCentipawns(const int score, const int ply) {
 	const auto [a, b] = ModelWDLForPly(ply);
 	return static_cast<int>(std::round(100.0 * static_cast<double>(score) / a));
 }
+
+// The inverse of the above, for scores given in centipawns (such as the classical evaluation's)
+int FromCentipawns(const int centipawns, const int ply) {
+	const auto [a, b] = ModelWDLForPly(ply);
+	return static_cast<int>(std::round(static_cast<double>(centipawns) * a / 100.0));
+}
+
+// CPU feature detection --------------------------------------------------------------------------
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+
+static std::array<uint32_t, 4> Cpuid(const uint32_t leaf, const uint32_t subleaf) {
+	std::array<int, 4> r{};
+	__cpuidex(r.data(), static_cast<int>(leaf), static_cast<int>(subleaf));
+	return { static_cast<uint32_t>(r[0]), static_cast<uint32_t>(r[1]), static_cast<uint32_t>(r[2]), static_cast<uint32_t>(r[3]) };
+}
+
+static uint64_t Xgetbv() {
+	return _xgetbv(0);
+}
+
+#define RENEGADE_HAS_CPUID
+
+#elif defined(__x86_64__) || defined(__i386__)
+
+static std::array<uint32_t, 4> Cpuid(const uint32_t leaf, const uint32_t subleaf) {
+	std::array<uint32_t, 4> r{};
+	if (!__get_cpuid_count(leaf, subleaf, &r[0], &r[1], &r[2], &r[3])) return { 0, 0, 0, 0 };
+	return r;
+}
+
+static uint64_t Xgetbv() {
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<uint64_t>(edx) << 32) | eax;
+}
+
+#define RENEGADE_HAS_CPUID
+
+#endif
+
+static CpuFeatures DetectCpuFeatures() {
+	CpuFeatures f;
+#if defined(RENEGADE_HAS_CPUID)
+	const auto leaf0 = Cpuid(0, 0);
+	const uint32_t maxLeaf = leaf0[0];
+	const bool amd = leaf0[1] == 0x68747541 && leaf0[3] == 0x69746e65 && leaf0[2] == 0x444d4163;  // "AuthenticAMD"
+
+	const auto leaf1 = Cpuid(1, 0);
+	f.SSE2 = CheckBit(leaf1[3], 26);
+	f.POPCNT = CheckBit(leaf1[2], 23);
+
+	// The OS must save the wider registers on context switches (XMM|YMM, then opmask|ZMM)
+	const bool osxsave = CheckBit(leaf1[2], 27);
+	const uint64_t xcr0 = osxsave ? Xgetbv() : 0;
+	const bool osAvx = (xcr0 & 0x06) == 0x06;
+	const bool osAvx512 = (xcr0 & 0xE6) == 0xE6;
+
+	if (maxLeaf >= 7) {
+		const auto leaf7 = Cpuid(7, 0);
+		f.AVX2 = osAvx && CheckBit(leaf7[1], 5);
+		f.BMI2 = CheckBit(leaf7[1], 8);
+		f.AVX512F = osAvx512 && CheckBit(leaf7[1], 16);
+		f.AVX512BW = osAvx512 && CheckBit(leaf7[1], 30);
+		f.AVX512VNNI = osAvx512 && CheckBit(leaf7[2], 11);
+	}
+
+	const uint32_t baseFamily = (leaf1[0] >> 8) & 0xF;
+	const uint32_t family = (baseFamily == 0xF) ? baseFamily + ((leaf1[0] >> 20) & 0xFF) : baseFamily;
+	f.FastPext = f.BMI2 && !(amd && family < 0x19);
+#endif
+	return f;
+}
+
+const CpuFeatures& GetCpuFeatures() {
+	static const CpuFeatures features = DetectCpuFeatures();
+	return features;
+}
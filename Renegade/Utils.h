@@ -42,6 +42,7 @@ static_assert(static_cast<int>(std::reduce(as.begin(), as.end())) == PawnNormali
 
 std::tuple<int, int, int> GetWDL(const int score, const int ply);
 int ToCentipawns(const int score, const int ply);
+int FromCentipawns(const int centipawns, const int ply);
 
 // Score range detection:
 static inline bool IsMateScore(const int score) {
@@ -189,7 +190,9 @@ struct SearchParams {
 	int depth = 0;
 	int movetime = 0;
 	int64_t softnodes = 0;
-	// + mate, searchmoves...
+	bool ponder = false;
+	std::vector<std::string> searchmoves = {};  // empty means all moves
+	// + mate...
 };
 
 struct SearchConstraints {
@@ -198,6 +201,7 @@ struct SearchConstraints {
 	int MaxDepth = -1;
 	int SearchTimeMin = -1;
 	int SearchTimeMax = -1;
+	int64_t NodesPerMs = 0;  // with nodestime the search times are measured in nodes instead
 };
 
 // Bitwise operations  ----------------------------------------------------------------------------
@@ -338,6 +342,22 @@ static inline uint8_t SquareToNum(const std::string& sq) {
 	return Square(rank, file);
 }
 
+// CPU feature detection ------------------------------------------------------------------------
+// Used for picking the fastest kernels at startup, each flag also requires support from the OS
+
+struct CpuFeatures {
+	bool SSE2 = false;
+	bool POPCNT = false;
+	bool AVX2 = false;
+	bool BMI2 = false;
+	bool AVX512F = false;
+	bool AVX512BW = false;
+	bool AVX512VNNI = false;
+	bool FastPext = false;  // pext is microcoded and very slow on AMD before Zen 3
+};
+
+const CpuFeatures& GetCpuFeatures();
+
 // Multidimensional array shenanigans -------------------------------------------------------------
 // Replace this with 'std::mdarray' if I live long enough to see the absolutely glacial speed of
 // C++ standards development and adaptation get there...